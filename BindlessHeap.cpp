@@ -0,0 +1,153 @@
+#include "BindlessHeap.h"
+
+#include <stdexcept>
+#include <string>
+
+BindlessHeap::BindlessHeap()
+	: m_device(VK_NULL_HANDLE)
+	, m_timeline(nullptr)
+	, m_layout(VK_NULL_HANDLE)
+	, m_set(VK_NULL_HANDLE)
+{
+}
+
+BindlessHeap::~BindlessHeap()
+{
+}
+
+void BindlessHeap::init(VkDevice device, DescriptorLayoutCache& layoutCache, TimelineSemaphore& timeline, uint32_t maxTextures, uint32_t maxBuffers)
+{
+	m_device = device;
+	m_timeline = &timeline;
+	m_textures = Slots();
+	m_textures.capacity = maxTextures;
+	m_buffers = Slots();
+	m_buffers.capacity = maxBuffers;
+
+	VkDescriptorSetLayoutBinding bindings[2]{};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount = maxTextures;
+	bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[1].descriptorCount = maxBuffers;
+	bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	const VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+	VkDescriptorBindingFlags bindingFlags[2] = { flags, flags };
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+	flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	flagsInfo.bindingCount = 2;
+	flagsInfo.pBindingFlags = bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = &flagsInfo;
+	layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = bindings;
+
+	m_layout = layoutCache.createLayout(layoutInfo);
+
+	//Exactly one set, so the pool is sized to it rather than by ratio
+	m_allocator.init(m_device, 1, {
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<float>(maxTextures) },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, static_cast<float>(maxBuffers) },
+	}, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT);
+	m_set = m_allocator.allocate(m_layout, layoutCache.getPoolSizes(m_layout));
+}
+
+//The layout belongs to the layout cache
+void BindlessHeap::destroy()
+{
+	m_allocator.destroy();
+	m_set = VK_NULL_HANDLE;
+	m_layout = VK_NULL_HANDLE;
+	m_textures = Slots();
+	m_buffers = Slots();
+}
+
+uint32_t BindlessHeap::addTexture(VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout)
+{
+	uint32_t index = acquire(m_textures, "texture");
+
+	VkDescriptorImageInfo imageInfo{ sampler, imageView, imageLayout };
+
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = m_set;
+	write.dstBinding = 0;
+	write.dstArrayElement = index;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+
+	return index;
+}
+
+uint32_t BindlessHeap::addBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	uint32_t index = acquire(m_buffers, "buffer");
+
+	VkDescriptorBufferInfo bufferInfo{ buffer, offset, range };
+
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = m_set;
+	write.dstBinding = 1;
+	write.dstArrayElement = index;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.pBufferInfo = &bufferInfo;
+	vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+
+	return index;
+}
+
+void BindlessHeap::removeTexture(uint32_t index, uint64_t value)
+{
+	release(m_textures, index, value);
+}
+
+void BindlessHeap::removeBuffer(uint32_t index, uint64_t value)
+{
+	release(m_buffers, index, value);
+}
+
+uint32_t BindlessHeap::acquire(Slots& slots, const char* kind)
+{
+	while (!slots.retired.empty() && m_timeline->isComplete(slots.retired.front().first))
+	{
+		slots.free.push_back(slots.retired.front().second);
+		slots.retired.pop_front();
+	}
+
+	if (!slots.free.empty())
+	{
+		uint32_t index = slots.free.back();
+		slots.free.pop_back();
+		return index;
+	}
+	if (slots.next < slots.capacity)
+	{
+		return slots.next++;
+	}
+	throw std::runtime_error(std::string("bindless ") + kind + " array is full!");
+}
+
+void BindlessHeap::release(Slots& slots, uint32_t index, uint64_t value)
+{
+	if (index == s_invalidIndex)
+	{
+		return;
+	}
+	if (value == s_nextSubmission)
+	{
+		value = m_timeline->getLastSubmitted() + 1;
+	}
+	slots.retired.emplace_back(value, index);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <utility>
+#include <vector>
+#include "DescriptorAllocator.h"
+#include "TimelineSemaphore.h"
+
+//Bindless resource model on descriptor indexing (core in Vulkan 1.2). A single descriptor set holds one large
+//update-after-bind array of textures (binding 0) and one of storage buffers (binding 1). It is bound once per command
+//buffer and shaders pick resources by index, so adding or drawing with a resource never binds anything.
+//Entries are partially bound and may be written while the set is in use by frames that do not touch them. A removed
+//index is only handed out again once the timeline has passed the value it was removed with, so a frame in flight
+//never sees its descriptor replaced underneath it.
+class BindlessHeap
+{
+public:
+	static const uint32_t s_invalidIndex = UINT32_MAX;
+	static const uint64_t s_nextSubmission = UINT64_MAX;
+
+	BindlessHeap();
+	~BindlessHeap();
+
+	void init(VkDevice device, DescriptorLayoutCache& layoutCache, TimelineSemaphore& timeline, uint32_t maxTextures, uint32_t maxBuffers);
+	void destroy();
+
+	bool isInitialised() const { return m_set != VK_NULL_HANDLE; }
+	VkDescriptorSetLayout getLayout() const { return m_layout; }
+	VkDescriptorSet getSet() const { return m_set; }
+
+	//Throw once the array is full
+	uint32_t addTexture(VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	uint32_t addBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+
+	//The default value is the next submission on the timeline, which covers a frame that is still being recorded
+	void removeTexture(uint32_t index, uint64_t value = s_nextSubmission);
+	void removeBuffer(uint32_t index, uint64_t value = s_nextSubmission);
+
+private:
+	//Hands out indices into one array, recycling removed ones once their timeline value has completed
+	struct Slots
+	{
+		uint32_t capacity = 0;
+		uint32_t next = 0;
+		std::vector<uint32_t> free;
+		std::deque<std::pair<uint64_t, uint32_t>> retired;
+	};
+
+	uint32_t acquire(Slots& slots, const char* kind);
+	void release(Slots& slots, uint32_t index, uint64_t value);
+
+	VkDevice m_device;
+	TimelineSemaphore* m_timeline;
+	DescriptorAllocator m_allocator;
+	VkDescriptorSetLayout m_layout;
+	VkDescriptorSet m_set;
+
+	Slots m_textures;
+	Slots m_buffers;
+};
@@ -0,0 +1,146 @@
+#include "DeletionQueue.h"
+
+DeletionQueue::DeletionQueue()
+	: m_device(VK_NULL_HANDLE)
+	, m_allocator(nullptr)
+	, m_timeline(nullptr)
+{
+}
+
+DeletionQueue::~DeletionQueue()
+{
+}
+
+void DeletionQueue::init(VkDevice device, MemoryAllocator& allocator, TimelineSemaphore& timeline)
+{
+	m_device = device;
+	m_allocator = &allocator;
+	m_timeline = &timeline;
+}
+
+void DeletionQueue::destroy()
+{
+	for (Entry& entry : m_entries)
+	{
+		release(entry);
+	}
+	m_entries.clear();
+	m_device = VK_NULL_HANDLE;
+}
+
+void DeletionQueue::destroyBuffer(VkBuffer buffer, const MemoryAllocation& memory, uint64_t value)
+{
+	Handle handle;
+	handle.buffer = buffer;
+	push(Type::Buffer, handle, memory, value);
+}
+
+void DeletionQueue::destroyImage(VkImage image, const MemoryAllocation& memory, uint64_t value)
+{
+	Handle handle;
+	handle.image = image;
+	push(Type::Image, handle, memory, value);
+}
+
+void DeletionQueue::destroyImageView(VkImageView imageView, uint64_t value)
+{
+	Handle handle;
+	handle.imageView = imageView;
+	push(Type::ImageView, handle, MemoryAllocation{}, value);
+}
+
+void DeletionQueue::destroyFramebuffer(VkFramebuffer framebuffer, uint64_t value)
+{
+	Handle handle;
+	handle.framebuffer = framebuffer;
+	push(Type::Framebuffer, handle, MemoryAllocation{}, value);
+}
+
+void DeletionQueue::destroySampler(VkSampler sampler, uint64_t value)
+{
+	Handle handle;
+	handle.sampler = sampler;
+	push(Type::Sampler, handle, MemoryAllocation{}, value);
+}
+
+void DeletionQueue::destroyPipeline(VkPipeline pipeline, uint64_t value)
+{
+	Handle handle;
+	handle.pipeline = pipeline;
+	push(Type::Pipeline, handle, MemoryAllocation{}, value);
+}
+
+void DeletionQueue::destroyPipelineLayout(VkPipelineLayout pipelineLayout, uint64_t value)
+{
+	Handle handle;
+	handle.pipelineLayout = pipelineLayout;
+	push(Type::PipelineLayout, handle, MemoryAllocation{}, value);
+}
+
+void DeletionQueue::destroyRenderPass(VkRenderPass renderPass, uint64_t value)
+{
+	Handle handle;
+	handle.renderPass = renderPass;
+	push(Type::RenderPass, handle, MemoryAllocation{}, value);
+}
+
+void DeletionQueue::destroySwapchain(VkSwapchainKHR swapchain, uint64_t value)
+{
+	Handle handle;
+	handle.swapchain = swapchain;
+	push(Type::Swapchain, handle, MemoryAllocation{}, value);
+}
+
+void DeletionQueue::freeMemory(const MemoryAllocation& memory, uint64_t value)
+{
+	Handle handle;
+	handle.buffer = VK_NULL_HANDLE;
+	push(Type::Memory, handle, memory, value);
+}
+
+void DeletionQueue::collect()
+{
+	if (m_entries.empty())
+	{
+		return;
+	}
+
+	uint64_t completed = m_timeline->getCompletedValue();
+	while (!m_entries.empty() && m_entries.front().value <= completed)
+	{
+		release(m_entries.front());
+		m_entries.pop_front();
+	}
+}
+
+void DeletionQueue::push(Type type, Handle handle, const MemoryAllocation& memory, uint64_t value)
+{
+	Entry entry;
+	entry.value = value == s_nextSubmission ? m_timeline->getLastSubmitted() + 1 : value;
+	entry.type = type;
+	entry.handle = handle;
+	entry.memory = memory;
+	m_entries.push_back(entry);
+}
+
+void DeletionQueue::release(Entry& entry)
+{
+	switch (entry.type)
+	{
+	case Type::Buffer: vkDestroyBuffer(m_device, entry.handle.buffer, nullptr); break;
+	case Type::Image: vkDestroyImage(m_device, entry.handle.image, nullptr); break;
+	case Type::ImageView: vkDestroyImageView(m_device, entry.handle.imageView, nullptr); break;
+	case Type::Framebuffer: vkDestroyFramebuffer(m_device, entry.handle.framebuffer, nullptr); break;
+	case Type::Sampler: vkDestroySampler(m_device, entry.handle.sampler, nullptr); break;
+	case Type::Pipeline: vkDestroyPipeline(m_device, entry.handle.pipeline, nullptr); break;
+	case Type::PipelineLayout: vkDestroyPipelineLayout(m_device, entry.handle.pipelineLayout, nullptr); break;
+	case Type::RenderPass: vkDestroyRenderPass(m_device, entry.handle.renderPass, nullptr); break;
+	case Type::Swapchain: vkDestroySwapchainKHR(m_device, entry.handle.swapchain, nullptr); break;
+	case Type::Memory: break;
+	}
+
+	if (entry.memory.isValid())
+	{
+		m_allocator->free(entry.memory);
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <deque>
+#include "MemoryAllocator.h"
+#include "TimelineSemaphore.h"
+
+//Defers destroying GPU objects until the GPU has finished with them, so content can be streamed out mid-run without a
+//vkDeviceWaitIdle. Each object is queued with a value on a timeline and released by collect() once that value has
+//completed. The default value is the next submission on the timeline, which covers a frame that is still being recorded.
+//Frame submissions wait for outstanding uploads, so that value also covers any upload that wrote the object.
+//Entries are released in queue order; one queued with an earlier value than the entry in front of it simply waits longer.
+class DeletionQueue
+{
+public:
+	static const uint64_t s_nextSubmission = UINT64_MAX;
+
+	DeletionQueue();
+	~DeletionQueue();
+
+	void init(VkDevice device, MemoryAllocator& allocator, TimelineSemaphore& timeline);
+	//Releases everything still queued, only call once the device is idle
+	void destroy();
+
+	void destroyBuffer(VkBuffer buffer, const MemoryAllocation& memory, uint64_t value = s_nextSubmission);
+	void destroyImage(VkImage image, const MemoryAllocation& memory, uint64_t value = s_nextSubmission);
+	void destroyImageView(VkImageView imageView, uint64_t value = s_nextSubmission);
+	void destroyFramebuffer(VkFramebuffer framebuffer, uint64_t value = s_nextSubmission);
+	void destroySampler(VkSampler sampler, uint64_t value = s_nextSubmission);
+	void destroyPipeline(VkPipeline pipeline, uint64_t value = s_nextSubmission);
+	void destroyPipelineLayout(VkPipelineLayout pipelineLayout, uint64_t value = s_nextSubmission);
+	void destroyRenderPass(VkRenderPass renderPass, uint64_t value = s_nextSubmission);
+	void destroySwapchain(VkSwapchainKHR swapchain, uint64_t value = s_nextSubmission);
+	void freeMemory(const MemoryAllocation& memory, uint64_t value = s_nextSubmission);
+
+	//Releases every entry whose value the timeline has reached, without blocking
+	void collect();
+	size_t getPendingCount() const { return m_entries.size(); }
+
+private:
+	enum class Type
+	{
+		Buffer,
+		Image,
+		ImageView,
+		Framebuffer,
+		Sampler,
+		Pipeline,
+		PipelineLayout,
+		RenderPass,
+		Swapchain,
+		Memory
+	};
+
+	union Handle
+	{
+		VkBuffer buffer;
+		VkImage image;
+		VkImageView imageView;
+		VkFramebuffer framebuffer;
+		VkSampler sampler;
+		VkPipeline pipeline;
+		VkPipelineLayout pipelineLayout;
+		VkRenderPass renderPass;
+		VkSwapchainKHR swapchain;
+	};
+
+	struct Entry
+	{
+		uint64_t value;
+		Type type;
+		Handle handle;
+		MemoryAllocation memory;
+	};
+
+	void push(Type type, Handle handle, const MemoryAllocation& memory, uint64_t value);
+	void release(Entry& entry);
+
+	VkDevice m_device;
+	MemoryAllocator* m_allocator;
+	TimelineSemaphore* m_timeline;
+	std::deque<Entry> m_entries;
+};
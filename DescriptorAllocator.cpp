@@ -0,0 +1,383 @@
+#include "DescriptorAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+//Pools stop growing here, past this a scene gets more pools rather than bigger ones
+static const uint32_t s_maxSetsPerPool = 4096;
+
+//Descriptors of one type a pool of setsPerPool sets reserves
+static uint32_t getRatioCount(const DescriptorAllocator::PoolRatio& ratio, uint32_t setsPerPool)
+{
+	return (std::max)(static_cast<uint32_t>(ratio.ratio * setsPerPool), 1u);
+}
+
+//Non-dispatchable handles are pointers on 64-bit targets and uint64_t on 32-bit ones
+template<typename T>
+static uint64_t handleKey(T handle)
+{
+	return (uint64_t)handle;
+}
+
+DescriptorLayoutCache::DescriptorLayoutCache()
+	: m_device(VK_NULL_HANDLE)
+{
+}
+
+DescriptorLayoutCache::~DescriptorLayoutCache()
+{
+}
+
+void DescriptorLayoutCache::init(VkDevice device)
+{
+	m_device = device;
+}
+
+void DescriptorLayoutCache::destroy()
+{
+	for (const auto& layout : m_layouts)
+	{
+		vkDestroyDescriptorSetLayout(m_device, layout.second, nullptr);
+	}
+	m_layouts.clear();
+	m_poolSizes.clear();
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::createLayout(const VkDescriptorSetLayoutCreateInfo& layoutInfo)
+{
+	const VkDescriptorBindingFlags* bindingFlags = nullptr;
+	for (const VkBaseInStructure* next = static_cast<const VkBaseInStructure*>(layoutInfo.pNext); next != nullptr; next = next->pNext)
+	{
+		if (next->sType != VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO)
+		{
+			throw std::runtime_error("descriptor layout cache cannot key this create info chain!");
+		}
+		const VkDescriptorSetLayoutBindingFlagsCreateInfo* flagsInfo = reinterpret_cast<const VkDescriptorSetLayoutBindingFlagsCreateInfo*>(next);
+		if (flagsInfo->bindingCount > 0)
+		{
+			bindingFlags = flagsInfo->pBindingFlags;
+		}
+	}
+
+	//Sorted by binding number so the same bindings listed in a different order share a layout
+	std::vector<uint32_t> order(layoutInfo.bindingCount);
+	for (uint32_t i = 0; i < layoutInfo.bindingCount; i++)
+	{
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&layoutInfo](uint32_t a, uint32_t b) { return layoutInfo.pBindings[a].binding < layoutInfo.pBindings[b].binding; });
+
+	std::vector<uint64_t> key;
+	key.push_back(layoutInfo.flags);
+	for (uint32_t i : order)
+	{
+		const VkDescriptorSetLayoutBinding& binding = layoutInfo.pBindings[i];
+		key.push_back(binding.binding);
+		key.push_back(static_cast<uint64_t>(binding.descriptorType));
+		key.push_back(binding.descriptorCount);
+		key.push_back(binding.stageFlags);
+		key.push_back(bindingFlags != nullptr ? bindingFlags[i] : 0);
+		key.push_back(binding.pImmutableSamplers != nullptr ? 1 : 0);
+		if (binding.pImmutableSamplers != nullptr)
+		{
+			for (uint32_t j = 0; j < binding.descriptorCount; j++)
+			{
+				key.push_back(handleKey(binding.pImmutableSamplers[j]));
+			}
+		}
+	}
+
+	auto found = m_layouts.find(key);
+	if (found != m_layouts.end())
+	{
+		return found->second;
+	}
+
+	VkDescriptorSetLayout layout;
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create descriptor set layout!");
+	}
+	m_layouts.emplace(std::move(key), layout);
+
+	std::vector<VkDescriptorPoolSize>& poolSizes = m_poolSizes[layout];
+	for (uint32_t i = 0; i < layoutInfo.bindingCount; i++)
+	{
+		const VkDescriptorSetLayoutBinding& binding = layoutInfo.pBindings[i];
+		auto size = std::find_if(poolSizes.begin(), poolSizes.end(), [&binding](const VkDescriptorPoolSize& entry) { return entry.type == binding.descriptorType; });
+		if (size != poolSizes.end())
+		{
+			size->descriptorCount += binding.descriptorCount;
+		}
+		else if (binding.descriptorCount > 0)
+		{
+			poolSizes.push_back({ binding.descriptorType, binding.descriptorCount });
+		}
+	}
+	return layout;
+}
+
+const std::vector<VkDescriptorPoolSize>& DescriptorLayoutCache::getPoolSizes(VkDescriptorSetLayout layout) const
+{
+	auto found = m_poolSizes.find(layout);
+	if (found == m_poolSizes.end())
+	{
+		throw std::runtime_error("descriptor set layout was not created by the layout cache!");
+	}
+	return found->second;
+}
+
+DescriptorAllocator::DescriptorAllocator()
+	: m_device(VK_NULL_HANDLE)
+	, m_poolFlags(0)
+	, m_minSetsPerPool(0)
+	, m_setsPerPool(0)
+	, m_currentPool(VK_NULL_HANDLE)
+	, m_allocatedSets(0)
+{
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+}
+
+void DescriptorAllocator::init(VkDevice device, uint32_t setsPerPool, const std::vector<PoolRatio>& ratios, VkDescriptorPoolCreateFlags poolFlags)
+{
+	m_device = device;
+	m_minSetsPerPool = (std::max)(setsPerPool, 1u);
+	m_setsPerPool = m_minSetsPerPool;
+	m_ratios = ratios;
+	m_poolFlags = poolFlags;
+}
+
+void DescriptorAllocator::destroy()
+{
+	for (VkDescriptorPool pool : m_usedPools)
+	{
+		vkDestroyDescriptorPool(m_device, pool, nullptr);
+	}
+	for (VkDescriptorPool pool : m_freePools)
+	{
+		vkDestroyDescriptorPool(m_device, pool, nullptr);
+	}
+	for (VkDescriptorPool pool : m_dedicatedPools)
+	{
+		vkDestroyDescriptorPool(m_device, pool, nullptr);
+	}
+	m_usedPools.clear();
+	m_freePools.clear();
+	m_dedicatedPools.clear();
+	m_currentPool = VK_NULL_HANDLE;
+	m_allocatedSets = 0;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout, const std::vector<VkDescriptorPoolSize>& layoutSizes, const void* pNext)
+{
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.pNext = pNext;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+
+	VkDescriptorSet set;
+	VkResult result;
+	if (!fitsPool(layoutSizes))
+	{
+		allocInfo.descriptorPool = createPool(layoutSizes, 1);
+		m_dedicatedPools.push_back(allocInfo.descriptorPool);
+		result = vkAllocateDescriptorSets(m_device, &allocInfo, &set);
+	}
+	else
+	{
+		if (m_currentPool == VK_NULL_HANDLE)
+		{
+			m_currentPool = grabPool();
+		}
+		allocInfo.descriptorPool = m_currentPool;
+		result = vkAllocateDescriptorSets(m_device, &allocInfo, &set);
+		if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+		{
+			//The full pool stays in m_usedPools until the next reset(), an empty pool has room for any set that fits
+			m_currentPool = grabPool();
+			allocInfo.descriptorPool = m_currentPool;
+			result = vkAllocateDescriptorSets(m_device, &allocInfo, &set);
+		}
+	}
+
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate descriptor set!");
+	}
+	m_allocatedSets++;
+	return set;
+}
+
+void DescriptorAllocator::reset()
+{
+	for (VkDescriptorPool pool : m_usedPools)
+	{
+		vkResetDescriptorPool(m_device, pool, 0);
+		m_freePools.push_back(pool);
+	}
+	m_usedPools.clear();
+	for (VkDescriptorPool pool : m_dedicatedPools)
+	{
+		vkDestroyDescriptorPool(m_device, pool, nullptr);
+	}
+	m_dedicatedPools.clear();
+	m_currentPool = VK_NULL_HANDLE;
+	m_allocatedSets = 0;
+}
+
+VkDescriptorPool DescriptorAllocator::grabPool()
+{
+	VkDescriptorPool pool;
+	if (!m_freePools.empty())
+	{
+		pool = m_freePools.back();
+		m_freePools.pop_back();
+	}
+	else
+	{
+		std::vector<VkDescriptorPoolSize> poolSizes;
+		for (const PoolRatio& ratio : m_ratios)
+		{
+			poolSizes.push_back({ ratio.type, getRatioCount(ratio, m_setsPerPool) });
+		}
+		pool = createPool(poolSizes, m_setsPerPool);
+		m_setsPerPool = (std::min)(m_setsPerPool * 2, s_maxSetsPerPool);
+	}
+
+	m_usedPools.push_back(pool);
+	return pool;
+}
+
+VkDescriptorPool DescriptorAllocator::createPool(const std::vector<VkDescriptorPoolSize>& poolSizes, uint32_t maxSets)
+{
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = m_poolFlags;
+	poolInfo.maxSets = maxSets;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+
+	VkDescriptorPool pool;
+	if (vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create descriptor pool!");
+	}
+	return pool;
+}
+
+//Checked against the smallest pool the allocator makes, so the set fits any pool once it is empty
+bool DescriptorAllocator::fitsPool(const std::vector<VkDescriptorPoolSize>& layoutSizes) const
+{
+	for (const VkDescriptorPoolSize& size : layoutSizes)
+	{
+		auto ratio = std::find_if(m_ratios.begin(), m_ratios.end(), [&size](const PoolRatio& entry) { return entry.type == size.type; });
+		if (ratio == m_ratios.end() || size.descriptorCount > getRatioCount(*ratio, m_minSetsPerPool))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+DescriptorSetCache::Binding DescriptorSetCache::bufferBinding(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	Binding result{};
+	result.binding = binding;
+	result.type = type;
+	result.buffer = { buffer, offset, range };
+	return result;
+}
+
+DescriptorSetCache::Binding DescriptorSetCache::imageBinding(uint32_t binding, VkDescriptorType type, VkSampler sampler, VkImageView imageView, VkImageLayout imageLayout)
+{
+	Binding result{};
+	result.binding = binding;
+	result.type = type;
+	result.image = { sampler, imageView, imageLayout };
+	return result;
+}
+
+DescriptorSetCache::DescriptorSetCache()
+	: m_device(VK_NULL_HANDLE)
+	, m_allocator(nullptr)
+	, m_layoutCache(nullptr)
+	, m_hits(0)
+	, m_misses(0)
+{
+}
+
+DescriptorSetCache::~DescriptorSetCache()
+{
+}
+
+void DescriptorSetCache::init(VkDevice device, DescriptorAllocator& allocator, const DescriptorLayoutCache& layoutCache)
+{
+	m_device = device;
+	m_allocator = &allocator;
+	m_layoutCache = &layoutCache;
+}
+
+VkDescriptorSet DescriptorSetCache::get(VkDescriptorSetLayout layout, const Binding* bindings, uint32_t bindingCount)
+{
+	std::vector<uint64_t> key;
+	key.reserve(1 + bindingCount * 6);
+	key.push_back(handleKey(layout));
+	for (uint32_t i = 0; i < bindingCount; i++)
+	{
+		const Binding& binding = bindings[i];
+		key.push_back(binding.binding);
+		key.push_back(static_cast<uint64_t>(binding.type));
+		key.push_back(handleKey(binding.buffer.buffer));
+		key.push_back(binding.buffer.offset);
+		key.push_back(binding.buffer.range);
+		key.push_back(handleKey(binding.image.sampler));
+		key.push_back(handleKey(binding.image.imageView));
+		key.push_back(static_cast<uint64_t>(binding.image.imageLayout));
+	}
+
+	auto found = m_sets.find(key);
+	if (found != m_sets.end())
+	{
+		m_hits++;
+		return found->second;
+	}
+	m_misses++;
+
+	VkDescriptorSet set = m_allocator->allocate(layout, m_layoutCache->getPoolSizes(layout));
+
+	std::vector<VkWriteDescriptorSet> writes(bindingCount);
+	for (uint32_t i = 0; i < bindingCount; i++)
+	{
+		const Binding& binding = bindings[i];
+		bool isImage = binding.type == VK_DESCRIPTOR_TYPE_SAMPLER || binding.type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+			binding.type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE || binding.type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+		writes[i] = VkWriteDescriptorSet{};
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = set;
+		writes[i].dstBinding = binding.binding;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = binding.type;
+		if (isImage)
+		{
+			writes[i].pImageInfo = &binding.image;
+		}
+		else
+		{
+			writes[i].pBufferInfo = &binding.buffer;
+		}
+	}
+	vkUpdateDescriptorSets(m_device, bindingCount, writes.data(), 0, nullptr);
+
+	m_sets.emplace(std::move(key), set);
+	return set;
+}
+
+void DescriptorSetCache::clear()
+{
+	m_sets.clear();
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <map>
+#include <vector>
+
+//Hands out one VkDescriptorSetLayout per distinct layout description, so pipelines and materials that describe the same
+//bindings share a layout and stay set compatible. Binding order in the create info does not matter, binding flags
+//chained through VkDescriptorSetLayoutBindingFlagsCreateInfo are part of the key. Layouts live until destroy().
+class DescriptorLayoutCache
+{
+public:
+	DescriptorLayoutCache();
+	~DescriptorLayoutCache();
+
+	void init(VkDevice device);
+	void destroy();
+
+	VkDescriptorSetLayout createLayout(const VkDescriptorSetLayoutCreateInfo& layoutInfo);
+	size_t getLayoutCount() const { return m_layouts.size(); }
+
+	//Descriptors of each type one set with the layout holds, what a pool needs to fit it. Throws for layouts the
+	//cache did not create
+	const std::vector<VkDescriptorPoolSize>& getPoolSizes(VkDescriptorSetLayout layout) const;
+
+private:
+	VkDevice m_device;
+	std::map<std::vector<uint64_t>, VkDescriptorSetLayout> m_layouts;
+	std::map<VkDescriptorSetLayout, std::vector<VkDescriptorPoolSize>> m_poolSizes;
+};
+
+//Allocates descriptor sets from a list of pools instead of one fixed size pool. When the current pool runs out
+//(VK_ERROR_OUT_OF_POOL_MEMORY or VK_ERROR_FRAGMENTED_POOL) the next one is taken from the free list or created, each
+//new pool twice the size of the last up to a cap. Sets are never freed one by one: reset() returns every pool to empty
+//in one call and keeps them for reuse, which is how the per-frame allocators in FrameContext are recycled. A layout
+//that would not fit an empty pool, because it needs more descriptors than the ratios give a pool or a type they leave
+//out, gets a pool sized for that one set, destroyed on reset().
+//Not thread safe, an allocator belongs to whoever records the frame or owns the long-lived sets.
+class DescriptorAllocator
+{
+public:
+	//Descriptors of each type reserved per set in a pool, e.g. 2.0 uniform buffers per set
+	struct PoolRatio
+	{
+		VkDescriptorType type;
+		float ratio;
+	};
+
+	DescriptorAllocator();
+	~DescriptorAllocator();
+
+	void init(VkDevice device, uint32_t setsPerPool, const std::vector<PoolRatio>& ratios, VkDescriptorPoolCreateFlags poolFlags = 0);
+	void destroy();
+
+	//layoutSizes are the layout's descriptor counts, see DescriptorLayoutCache::getPoolSizes(). pNext is passed through
+	//to VkDescriptorSetAllocateInfo, e.g. for variable descriptor counts
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout, const std::vector<VkDescriptorPoolSize>& layoutSizes, const void* pNext = nullptr);
+	void reset();
+
+	size_t getPoolCount() const { return m_usedPools.size() + m_freePools.size() + m_dedicatedPools.size(); }
+	uint32_t getAllocatedSets() const { return m_allocatedSets; }
+
+private:
+	VkDescriptorPool grabPool();
+	VkDescriptorPool createPool(const std::vector<VkDescriptorPoolSize>& poolSizes, uint32_t maxSets);
+	bool fitsPool(const std::vector<VkDescriptorPoolSize>& layoutSizes) const;
+
+	VkDevice m_device;
+	std::vector<PoolRatio> m_ratios;
+	VkDescriptorPoolCreateFlags m_poolFlags;
+	//Pools start at m_minSetsPerPool, so every pool has room for a set that fits a pool of that size
+	uint32_t m_minSetsPerPool;
+	uint32_t m_setsPerPool;
+
+	VkDescriptorPool m_currentPool;
+	std::vector<VkDescriptorPool> m_usedPools;
+	std::vector<VkDescriptorPool> m_freePools;
+	std::vector<VkDescriptorPool> m_dedicatedPools;
+	uint32_t m_allocatedSets;
+};
+
+//Returns the same descriptor set for the same layout and bound resources, writing a new set only on a miss. Sets come
+//from the DescriptorAllocator given to init(), so a cache over a per-frame allocator has to be cleared whenever that
+//allocator is reset. Entries are keyed by handle, so clear() it as well before resources in it are destroyed.
+class DescriptorSetCache
+{
+public:
+	//One descriptor to write, either a buffer or an image depending on type. Arrays are not cached
+	struct Binding
+	{
+		uint32_t binding;
+		VkDescriptorType type;
+		VkDescriptorBufferInfo buffer;
+		VkDescriptorImageInfo image;
+	};
+
+	static Binding bufferBinding(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+	static Binding imageBinding(uint32_t binding, VkDescriptorType type, VkSampler sampler, VkImageView imageView, VkImageLayout imageLayout);
+
+	DescriptorSetCache();
+	~DescriptorSetCache();
+
+	//Every layout passed to get() has to come from layoutCache, which sizes the pools for it
+	void init(VkDevice device, DescriptorAllocator& allocator, const DescriptorLayoutCache& layoutCache);
+
+	VkDescriptorSet get(VkDescriptorSetLayout layout, const Binding* bindings, uint32_t bindingCount);
+	void clear();
+
+	size_t getSetCount() const { return m_sets.size(); }
+	uint64_t getHits() const { return m_hits; }
+	uint64_t getMisses() const { return m_misses; }
+
+private:
+	VkDevice m_device;
+	DescriptorAllocator* m_allocator;
+	const DescriptorLayoutCache* m_layoutCache;
+	std::map<std::vector<uint64_t>, VkDescriptorSet> m_sets;
+	uint64_t m_hits;
+	uint64_t m_misses;
+};
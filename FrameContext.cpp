@@ -0,0 +1,159 @@
+#include "FrameContext.h"
+
+#include <stdexcept>
+
+//Size of a frame's first descriptor pool, the allocator adds bigger ones if a frame needs more
+static const uint32_t s_descriptorSetsPerFrame = 64;
+
+FrameContext::FrameContext()
+	: m_device(VK_NULL_HANDLE)
+	, m_allocator(nullptr)
+	, m_commandPool(VK_NULL_HANDLE)
+	, m_commandBuffer(VK_NULL_HANDLE)
+	, m_uniformSet(VK_NULL_HANDLE)
+	, m_scratchBuffer(VK_NULL_HANDLE)
+	, m_scratchSize(0)
+	, m_scratchHead(0)
+{
+}
+
+FrameContext::~FrameContext()
+{
+}
+
+void FrameContext::init(VkDevice device, MemoryAllocator& allocator, const DescriptorLayoutCache& layoutCache, uint32_t queueFamilyIndex, uint32_t workerCount, VkDeviceSize scratchSize)
+{
+	m_device = device;
+	m_allocator = &allocator;
+	m_scratchSize = scratchSize;
+
+	//Transient and without RESET_COMMAND_BUFFER_BIT: buffers are only ever reset together with their pool
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+	if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create frame command pool!");
+	}
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = m_commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+
+	if (vkAllocateCommandBuffers(m_device, &allocInfo, &m_commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate command buffers!");
+	}
+
+	m_workerCommandPools.assign(workerCount, VK_NULL_HANDLE);
+	m_secondaryCommandBuffers.assign(workerCount, VK_NULL_HANDLE);
+	for (uint32_t i = 0; i < workerCount; i++)
+	{
+		if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_workerCommandPools[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create worker command pool!");
+		}
+
+		allocInfo.commandPool = m_workerCommandPools[i];
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		if (vkAllocateCommandBuffers(m_device, &allocInfo, &m_secondaryCommandBuffers[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate secondary command buffer!");
+		}
+	}
+
+	m_descriptorAllocator.init(m_device, s_descriptorSetsPerFrame, {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f },
+	});
+	m_descriptorSets.init(m_device, m_descriptorAllocator, layoutCache);
+
+	if (m_scratchSize > 0)
+	{
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = m_scratchSize;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &m_scratchBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create frame scratch buffer!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(m_device, m_scratchBuffer, &memRequirements);
+		m_scratchMemory = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true);
+		vkBindBufferMemory(m_device, m_scratchBuffer, m_scratchMemory.memory, m_scratchMemory.offset);
+	}
+}
+
+void FrameContext::destroy()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkDestroyBuffer(m_device, m_scratchBuffer, nullptr);
+	m_allocator->free(m_scratchMemory);
+	m_scratchBuffer = VK_NULL_HANDLE;
+
+	m_descriptorSets.clear();
+	m_descriptorAllocator.destroy();
+	m_uniformSet = VK_NULL_HANDLE;
+
+	for (VkCommandPool pool : m_workerCommandPools)
+	{
+		vkDestroyCommandPool(m_device, pool, nullptr);
+	}
+	m_workerCommandPools.clear();
+	m_secondaryCommandBuffers.clear();
+
+	vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+	m_commandPool = VK_NULL_HANDLE;
+	m_commandBuffer = VK_NULL_HANDLE;
+
+	m_device = VK_NULL_HANDLE;
+}
+
+void FrameContext::createUniformSet(DescriptorSetCache& setCache, VkDescriptorSetLayout layout, const VkDescriptorType* bindingTypes, const VkDeviceSize* bindingRanges, uint32_t bindingCount)
+{
+	std::vector<DescriptorSetCache::Binding> bindings(bindingCount);
+	for (uint32_t i = 0; i < bindingCount; i++)
+	{
+		bindings[i] = DescriptorSetCache::bufferBinding(i, bindingTypes[i], m_scratchBuffer, 0, bindingRanges[i]);
+	}
+	m_uniformSet = setCache.get(layout, bindings.data(), bindingCount);
+}
+
+void FrameContext::reset()
+{
+	vkResetCommandPool(m_device, m_commandPool, 0);
+	m_descriptorSets.clear();
+	m_descriptorAllocator.reset();
+	m_scratchHead = 0;
+}
+
+FrameContext::ScratchAllocation FrameContext::allocateScratch(VkDeviceSize size, VkDeviceSize alignment)
+{
+	VkDeviceSize offset = alignment > 1 ? (m_scratchHead + alignment - 1) / alignment * alignment : m_scratchHead;
+	if (offset + size > m_scratchSize)
+	{
+		throw std::runtime_error("frame scratch buffer exhausted!");
+	}
+	m_scratchHead = offset + size;
+
+	ScratchAllocation allocation;
+	allocation.buffer = m_scratchBuffer;
+	allocation.offset = offset;
+	allocation.data = static_cast<char*>(m_scratchMemory.mappedData) + offset;
+	return allocation;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include "MemoryAllocator.h"
+#include "DescriptorAllocator.h"
+
+//Everything a single frame in flight allocates from while it is being recorded: a transient command pool holding the
+//primary command buffer, one pool plus secondary buffer per recording worker, a growable descriptor allocator with a
+//set cache for per-frame sets and a persistently mapped scratch buffer for transient data, which doubles as the frame's
+//uniform ring: a long-lived descriptor set points its dynamic buffer bindings at the scratch buffer, so per-frame and
+//per-draw constants are bump allocated, written through the mapping and selected with dynamic offsets. None of it is freed piece by piece. Once the GPU has
+//finished the frame, reset() returns the primary pool, the descriptor pools and the scratch buffer to empty in one go.
+class FrameContext
+{
+public:
+	struct ScratchAllocation
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		void* data = nullptr;
+	};
+
+	FrameContext();
+	~FrameContext();
+
+	//layoutCache sizes descriptor pools for the layouts getDescriptorSetCache() is used with
+	void init(VkDevice device, MemoryAllocator& allocator, const DescriptorLayoutCache& layoutCache, uint32_t queueFamilyIndex, uint32_t workerCount, VkDeviceSize scratchSize);
+	void destroy();
+
+	//Worker pools are left alone, each worker resets its own in parallel before recording
+	void reset();
+
+	VkCommandBuffer getCommandBuffer() const { return m_commandBuffer; }
+	VkCommandPool getWorkerCommandPool(uint32_t worker) const { return m_workerCommandPools[worker]; }
+	VkCommandBuffer getSecondaryCommandBuffer(uint32_t worker) const { return m_secondaryCommandBuffers[worker]; }
+	//Sets from these are only valid until the next reset()
+	DescriptorAllocator& getDescriptorAllocator() { return m_descriptorAllocator; }
+	DescriptorSetCache& getDescriptorSetCache() { return m_descriptorSets; }
+
+	//Gets the set from the long-lived setCache, pointing binding i at the start of the scratch buffer with bindingRanges[i]
+	//as its range. Bindings have to be dynamic uniform or dynamic storage buffers, given in bindingTypes
+	void createUniformSet(DescriptorSetCache& setCache, VkDescriptorSetLayout layout, const VkDescriptorType* bindingTypes, const VkDeviceSize* bindingRanges, uint32_t bindingCount);
+	VkDescriptorSet getUniformSet() const { return m_uniformSet; }
+
+	//Bump allocation from the scratch buffer, valid until the next reset(). Throws once the buffer is exhausted
+	ScratchAllocation allocateScratch(VkDeviceSize size, VkDeviceSize alignment);
+	VkDeviceSize getScratchUsed() const { return m_scratchHead; }
+	VkBuffer getScratchBuffer() const { return m_scratchBuffer; }
+
+private:
+	VkDevice m_device;
+	MemoryAllocator* m_allocator;
+
+	VkCommandPool m_commandPool;
+	VkCommandBuffer m_commandBuffer;
+
+	std::vector<VkCommandPool> m_workerCommandPools;
+	std::vector<VkCommandBuffer> m_secondaryCommandBuffers;
+
+	DescriptorAllocator m_descriptorAllocator;
+	DescriptorSetCache m_descriptorSets;
+
+	//Not from m_descriptorAllocator because the uniform set survives reset()
+	VkDescriptorSet m_uniformSet;
+
+	VkBuffer m_scratchBuffer;
+	MemoryAllocation m_scratchMemory;
+	VkDeviceSize m_scratchSize;
+	VkDeviceSize m_scratchHead;
+};
@@ -0,0 +1,62 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <thread>
+
+FramePacer::FramePacer()
+	: m_targetLatencyMs(0.0)
+	, m_submitted(false)
+{
+}
+
+void FramePacer::init(double targetLatencyMs)
+{
+	m_targetLatencyMs = (std::max)(targetLatencyMs, 0.0);
+	m_submitted = false;
+}
+
+double FramePacer::wait(TimelineSemaphore& timeline, uint64_t previousValue, double cpuMs, double gpuMs)
+{
+	if (!isEnabled() || !m_submitted)
+	{
+		return 0.0;
+	}
+
+	//GPU already idle, nothing for the new frame to queue behind
+	if (timeline.isComplete(previousValue))
+	{
+		return 0.0;
+	}
+
+	Clock::time_point start = Clock::now();
+	double cpuEstimate = (std::max)(cpuMs, 0.0);
+	double gpuEstimate = (std::max)(gpuMs, 0.0);
+
+	//How long the new frame may sit behind the previous one and still finish within the target
+	double slackMs = m_targetLatencyMs - cpuEstimate - gpuEstimate;
+	if (slackMs <= 0.0)
+	{
+		//The target cannot be met even with an idle GPU, so get as close as possible by not queueing at all
+		timeline.wait(previousValue);
+	}
+	else
+	{
+		//The previous frame was submitted behind at most slackMs of earlier work, so it should finish about
+		//gpuEstimate after its submit. Sleep until the remainder fits into the slack, unless it finishes sooner
+		Clock::time_point predictedDone = m_lastSubmit + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(gpuEstimate));
+		Clock::time_point wakeAt = predictedDone - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(slackMs));
+		if (wakeAt > start)
+		{
+			uint64_t timeout = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(wakeAt - start).count());
+			timeline.wait(previousValue, timeout);
+		}
+	}
+
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void FramePacer::frameSubmitted()
+{
+	m_lastSubmit = Clock::now();
+	m_submitted = true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <chrono>
+#include "TimelineSemaphore.h"
+
+//Optional latency limiter for the render loop. With frames in flight the CPU can run ahead of the GPU, so input
+//polled for a new frame waits behind whole queued frames before it reaches the screen. When a target latency is set,
+//wait() runs before input is polled and holds the CPU back until the previous frame is predicted to finish early
+//enough that the new frame's CPU and GPU work both fit within the target. Predictions come from the last measured
+//CPU and GPU times, so the limiter trades throughput for latency and does nothing while no target is set.
+class FramePacer
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	FramePacer();
+
+	void init(double targetLatencyMs);
+	bool isEnabled() const { return m_targetLatencyMs > 0.0; }
+
+	//previousValue is what the most recently submitted frame signals on the frame timeline. cpuMs and gpuMs are the
+	//latest measured times, negative when not yet known. Returns the time spent waiting in milliseconds
+	double wait(TimelineSemaphore& timeline, uint64_t previousValue, double cpuMs, double gpuMs);
+
+	//Call right after the frame's work has been submitted
+	void frameSubmitted();
+
+private:
+	double m_targetLatencyMs;
+	Clock::time_point m_lastSubmit;
+	bool m_submitted;
+};
@@ -0,0 +1,350 @@
+#include "FrameProfiler.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+FrameProfiler::FrameProfiler()
+	: m_device(VK_NULL_HANDLE)
+	, m_queryPool(VK_NULL_HANDLE)
+	, m_timestampPeriod(0.0)
+	, m_timestampMask(0)
+	, m_currentSlot(0)
+	, m_frameNumber(0)
+	, m_inFrame(false)
+{
+	std::fill(std::begin(m_latest), std::end(m_latest), -1.0);
+}
+
+FrameProfiler::~FrameProfiler()
+{
+}
+
+void FrameProfiler::init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, uint32_t framesInFlight, size_t historySize)
+{
+	m_device = device;
+	m_history.assign(std::max<size_t>(historySize, 1), Sample{});
+	m_gpuSlots.assign(framesInFlight, GpuSlot{});
+	m_frameNumber = 0;
+	m_inFrame = false;
+	std::fill(std::begin(m_latest), std::end(m_latest), -1.0);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	//A queue family without valid timestamp bits cannot be timed, CPU phases are still recorded
+	uint32_t validBits = queueFamilyIndex < queueFamilyCount ? queueFamilies[queueFamilyIndex].timestampValidBits : 0;
+	if (validBits == 0 || properties.limits.timestampPeriod <= 0.0f)
+	{
+		std::cout << "Frame profiler: GPU timestamps not supported on queue family " << queueFamilyIndex << std::endl;
+		return;
+	}
+
+	m_timestampPeriod = properties.limits.timestampPeriod;
+	m_timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+
+	VkQueryPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = framesInFlight * 2;
+
+	if (vkCreateQueryPool(m_device, &poolInfo, nullptr, &m_queryPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create timestamp query pool!");
+	}
+}
+
+void FrameProfiler::destroy()
+{
+	if (m_queryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(m_device, m_queryPool, nullptr);
+		m_queryPool = VK_NULL_HANDLE;
+	}
+	m_device = VK_NULL_HANDLE;
+}
+
+void FrameProfiler::beginFrame(uint32_t slot)
+{
+	Clock::time_point now = Clock::now();
+
+	//A frame that was abandoned part way (e.g. swapchain out of date) is simply overwritten
+	Sample& sample = currentSample();
+	sample.frame = m_frameNumber;
+	std::fill(std::begin(sample.values), std::end(sample.values), -1.0);
+
+	if (m_frameNumber > 0)
+	{
+		store(sample, FrameInterval, std::chrono::duration<double, std::milli>(now - m_previousFrameStart).count());
+	}
+
+	m_currentSlot = slot;
+	m_frameStart = now;
+	m_inFrame = true;
+}
+
+void FrameProfiler::endFrame()
+{
+	if (!m_inFrame)
+	{
+		return;
+	}
+
+	store(currentSample(), CpuFrame, std::chrono::duration<double, std::milli>(Clock::now() - m_frameStart).count());
+
+	//endFrame() is only reached once the frame was submitted, so from here its slot has work in flight
+	GpuSlot& slot = m_gpuSlots[m_currentSlot];
+	slot.submittedFrame = m_frameNumber;
+	slot.frameStart = m_frameStart;
+	slot.inFlight = true;
+
+	m_previousFrameStart = m_frameStart;
+	m_frameNumber++;
+	m_inFrame = false;
+}
+
+void FrameProfiler::beginPhase(Metric metric)
+{
+	m_phaseStart[metric] = Clock::now();
+}
+
+void FrameProfiler::endPhase(Metric metric)
+{
+	store(currentSample(), metric, std::chrono::duration<double, std::milli>(Clock::now() - m_phaseStart[metric]).count());
+}
+
+void FrameProfiler::recordPhase(Metric metric, double ms)
+{
+	store(currentSample(), metric, ms);
+}
+
+void FrameProfiler::store(Sample& sample, Metric metric, double ms)
+{
+	sample.values[metric] = ms;
+	m_latest[metric] = ms;
+}
+
+void FrameProfiler::resolveGpuTimings()
+{
+	frameCompleted(m_currentSlot);
+	resolveSlot(m_currentSlot);
+}
+
+void FrameProfiler::frameCompleted(uint32_t slot)
+{
+	GpuSlot& gpuSlot = m_gpuSlots[slot];
+	if (!gpuSlot.inFlight)
+	{
+		return;
+	}
+	gpuSlot.inFlight = false;
+
+	Sample& sample = m_history[gpuSlot.submittedFrame % m_history.size()];
+	if (sample.frame == gpuSlot.submittedFrame)
+	{
+		store(sample, Latency, std::chrono::duration<double, std::milli>(Clock::now() - gpuSlot.frameStart).count());
+	}
+}
+
+void FrameProfiler::resolveAllGpuTimings()
+{
+	for (uint32_t i = 0; i < m_gpuSlots.size(); i++)
+	{
+		resolveSlot(i);
+	}
+}
+
+void FrameProfiler::resolveSlot(uint32_t index)
+{
+	if (m_queryPool == VK_NULL_HANDLE || !m_gpuSlots[index].pending)
+	{
+		return;
+	}
+
+	GpuSlot& slot = m_gpuSlots[index];
+	uint64_t timestamps[2];
+	VkResult result = vkGetQueryPoolResults(m_device, m_queryPool, index * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result == VK_NOT_READY)
+	{
+		return;
+	}
+	slot.pending = false;
+
+	//Only store it if that frame is still inside the history window
+	Sample& sample = m_history[slot.frame % m_history.size()];
+	if (result == VK_SUCCESS && sample.frame == slot.frame)
+	{
+		uint64_t ticks = (timestamps[1] - timestamps[0]) & m_timestampMask;
+		store(sample, Gpu, ticks * m_timestampPeriod / 1000000.0);
+	}
+}
+
+void FrameProfiler::writeGpuBegin(VkCommandBuffer commandBuffer)
+{
+	if (m_queryPool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkCmdResetQueryPool(commandBuffer, m_queryPool, m_currentSlot * 2, 2);
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, m_currentSlot * 2);
+}
+
+void FrameProfiler::writeGpuEnd(VkCommandBuffer commandBuffer)
+{
+	if (m_queryPool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, m_currentSlot * 2 + 1);
+	m_gpuSlots[m_currentSlot].frame = m_frameNumber;
+	m_gpuSlots[m_currentSlot].pending = true;
+}
+
+size_t FrameProfiler::getSampleCount() const
+{
+	return static_cast<size_t>(std::min<uint64_t>(m_frameNumber, m_history.size()));
+}
+
+FrameProfiler::Percentiles FrameProfiler::getPercentiles(Metric metric) const
+{
+	Percentiles percentiles;
+
+	std::vector<double> values;
+	values.reserve(getSampleCount());
+	for (uint64_t frame = m_frameNumber - getSampleCount(); frame < m_frameNumber; frame++)
+	{
+		double value = m_history[frame % m_history.size()].values[metric];
+		if (value >= 0.0)
+		{
+			values.push_back(value);
+		}
+	}
+
+	if (values.empty())
+	{
+		return percentiles;
+	}
+
+	std::sort(values.begin(), values.end());
+	auto rank = [&](double p) {
+		size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+		return values[std::min(index, values.size() - 1)];
+	};
+
+	double total = 0.0;
+	for (double value : values)
+	{
+		total += value;
+	}
+
+	percentiles.p50 = rank(0.50);
+	percentiles.p95 = rank(0.95);
+	percentiles.p99 = rank(0.99);
+	percentiles.average = total / values.size();
+	percentiles.max = values.back();
+	percentiles.sampleCount = values.size();
+	return percentiles;
+}
+
+const char* FrameProfiler::getMetricName(Metric metric)
+{
+	switch (metric)
+	{
+	case FenceWait: return "fence_wait";
+	case Acquire: return "acquire";
+	case Record: return "record";
+	case Submit: return "submit";
+	case Present: return "present";
+	case CpuFrame: return "cpu_frame";
+	case FrameInterval: return "frame_interval";
+	case Gpu: return "gpu";
+	case Pacing: return "pacing";
+	case Latency: return "latency";
+	default: return "unknown";
+	}
+}
+
+void FrameProfiler::printSummary() const
+{
+	std::cout << "Frame timings over the last " << getSampleCount() << " frames (ms, p50/p95/p99):" << std::endl;
+	for (int i = 0; i < MetricCount; i++)
+	{
+		Percentiles percentiles = getPercentiles(static_cast<Metric>(i));
+		if (percentiles.sampleCount == 0)
+		{
+			continue;
+		}
+		std::cout << "  " << getMetricName(static_cast<Metric>(i)) << ": "
+			<< percentiles.p50 << " / " << percentiles.p95 << " / " << percentiles.p99 << std::endl;
+	}
+}
+
+//One row per frame in the history window, oldest first. Unmeasured metrics are left empty
+bool FrameProfiler::dumpCsv(const std::string& path) const
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Frame profiler: could not write " << path << std::endl;
+		return false;
+	}
+
+	file << "frame";
+	for (int i = 0; i < MetricCount; i++)
+	{
+		file << "," << getMetricName(static_cast<Metric>(i));
+	}
+	file << "\n";
+
+	size_t count = getSampleCount();
+	for (uint64_t frame = m_frameNumber - count; frame < m_frameNumber; frame++)
+	{
+		const Sample& sample = m_history[frame % m_history.size()];
+		file << sample.frame;
+		for (int i = 0; i < MetricCount; i++)
+		{
+			file << ",";
+			if (sample.values[i] >= 0.0)
+			{
+				file << sample.values[i];
+			}
+		}
+		file << "\n";
+	}
+
+	return file.good();
+}
+
+bool FrameProfiler::dumpJson(const std::string& path) const
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Frame profiler: could not write " << path << std::endl;
+		return false;
+	}
+
+	file << "{\n  \"frames\": " << m_frameNumber << ",\n  \"window\": " << getSampleCount() << ",\n  \"metrics\": {";
+	for (int i = 0; i < MetricCount; i++)
+	{
+		Percentiles percentiles = getPercentiles(static_cast<Metric>(i));
+		file << (i == 0 ? "\n" : ",\n") << "    \"" << getMetricName(static_cast<Metric>(i)) << "\": { "
+			<< "\"samples\": " << percentiles.sampleCount << ", "
+			<< "\"p50\": " << percentiles.p50 << ", "
+			<< "\"p95\": " << percentiles.p95 << ", "
+			<< "\"p99\": " << percentiles.p99 << ", "
+			<< "\"average\": " << percentiles.average << ", "
+			<< "\"max\": " << percentiles.max << " }";
+	}
+	file << "\n  }\n}\n";
+
+	return file.good();
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+//Per-frame timing for the render loop. CPU phases are measured with steady_clock around the wait for the frame slot, acquire,
+//record, submit and present calls; GPU time comes from a pair of timestamp queries written around the render pass.
+//Each frame in flight owns its own query pair, read back once that frame's GPU work has completed, so reading results
+//never stalls. Latency runs from the start of a frame, just after input was polled, until the CPU first sees that
+//frame completed on the GPU, so it is an upper bound on input-to-GPU-completion. The last historySize frames are kept
+//for percentiles and for dumping to CSV or JSON.
+class FrameProfiler
+{
+public:
+	enum Metric
+	{
+		FenceWait,
+		Acquire,
+		Record,
+		Submit,
+		Present,
+		CpuFrame,
+		FrameInterval,
+		Gpu,
+		Pacing,
+		Latency,
+		MetricCount
+	};
+
+	struct Percentiles
+	{
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+		double average = 0.0;
+		double max = 0.0;
+		size_t sampleCount = 0;
+	};
+
+	FrameProfiler();
+	~FrameProfiler();
+
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, uint32_t framesInFlight, size_t historySize = 1000);
+	void destroy();
+
+	//slot is the frame-in-flight index whose query pair this frame records into
+	void beginFrame(uint32_t slot);
+	void endFrame();
+
+	void beginPhase(Metric metric);
+	void endPhase(Metric metric);
+	//For time measured outside beginFrame()/endFrame(), such as the pacing wait before input is polled
+	void recordPhase(Metric metric, double ms);
+
+	//Reads back the GPU time of the previous frame that used this slot, call after its work has been waited on
+	void resolveGpuTimings();
+	//Records the latency of the frame that last used this slot, call as soon as its work is seen complete
+	void frameCompleted(uint32_t slot);
+	//Reads back every slot, only meaningful once the device is idle
+	void resolveAllGpuTimings();
+	void writeGpuBegin(VkCommandBuffer commandBuffer);
+	void writeGpuEnd(VkCommandBuffer commandBuffer);
+
+	Percentiles getPercentiles(Metric metric) const;
+	//Most recent value measured for the metric, negative until it has been measured once
+	double getLatest(Metric metric) const { return m_latest[metric]; }
+	bool hasGpuTimings() const { return m_queryPool != VK_NULL_HANDLE; }
+	uint64_t getFrameCount() const { return m_frameNumber; }
+
+	void printSummary() const;
+	bool dumpCsv(const std::string& path) const;
+	bool dumpJson(const std::string& path) const;
+
+	static const char* getMetricName(Metric metric);
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	//Times are in milliseconds, negative when the metric was not measured for that frame
+	struct Sample
+	{
+		uint64_t frame = 0;
+		double values[MetricCount];
+	};
+
+	struct GpuSlot
+	{
+		uint64_t frame = 0;
+		bool pending = false;
+
+		//Set when a frame using this slot is submitted, cleared by frameCompleted()
+		uint64_t submittedFrame = 0;
+		Clock::time_point frameStart;
+		bool inFlight = false;
+	};
+
+	Sample& currentSample() { return m_history[m_frameNumber % m_history.size()]; }
+	void resolveSlot(uint32_t index);
+	void store(Sample& sample, Metric metric, double ms);
+	size_t getSampleCount() const;
+
+	VkDevice m_device;
+	VkQueryPool m_queryPool;
+	double m_timestampPeriod;
+	uint64_t m_timestampMask;
+
+	std::vector<GpuSlot> m_gpuSlots;
+	uint32_t m_currentSlot;
+
+	std::vector<Sample> m_history;
+	uint64_t m_frameNumber;
+	bool m_inFrame;
+
+	Clock::time_point m_frameStart;
+	Clock::time_point m_previousFrameStart;
+	Clock::time_point m_phaseStart[MetricCount];
+	double m_latest[MetricCount];
+};
@@ -0,0 +1,67 @@
+#include "InstanceBatcher.h"
+
+#include <cstring>
+
+InstanceBatcher::InstanceBatcher()
+	: m_splitByMaterial(true)
+	, m_instanceCount(0)
+{
+}
+
+InstanceBatcher::~InstanceBatcher()
+{
+}
+
+void InstanceBatcher::init(bool splitByMaterial)
+{
+	m_splitByMaterial = splitByMaterial;
+	m_groupIndices.clear();
+	m_groups.clear();
+	m_batches.clear();
+	m_instanceCount = 0;
+}
+
+void InstanceBatcher::add(uint32_t mesh, uint32_t material, const InstanceData* instances, uint32_t instanceCount)
+{
+	if (instanceCount == 0)
+	{
+		return;
+	}
+	if (!m_splitByMaterial)
+	{
+		material = 0;
+	}
+
+	uint64_t key = static_cast<uint64_t>(mesh) << 32 | material;
+	auto found = m_groupIndices.find(key);
+	if (found == m_groupIndices.end())
+	{
+		found = m_groupIndices.emplace(key, static_cast<uint32_t>(m_groups.size())).first;
+		m_groups.push_back(Group{ mesh, material, {} });
+	}
+
+	std::vector<InstanceData>& group = m_groups[found->second].instances;
+	group.insert(group.end(), instances, instances + instanceCount);
+	m_instanceCount += instanceCount;
+}
+
+//Groups left empty by this frame are skipped but kept, the scene is likely to submit them again next frame
+void InstanceBatcher::build(InstanceData* destination)
+{
+	m_batches.clear();
+	uint32_t firstInstance = 0;
+	for (Group& group : m_groups)
+	{
+		if (group.instances.empty())
+		{
+			continue;
+		}
+
+		uint32_t instanceCount = static_cast<uint32_t>(group.instances.size());
+		memcpy(destination + firstInstance, group.instances.data(), sizeof(InstanceData) * instanceCount);
+		m_batches.push_back(Batch{ group.mesh, group.material, firstInstance, instanceCount });
+		firstInstance += instanceCount;
+		group.instances.clear();
+	}
+	m_instanceCount = 0;
+}
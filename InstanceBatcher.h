@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "vertex.h"
+
+//Collects the instances submitted for a frame and groups those sharing a mesh (and, unless materials are read per
+//instance, a material) so each group is drawn with one instanced call however many times it was submitted. Groups
+//keep their storage between frames, so a steady scene stops allocating after its first frame.
+class InstanceBatcher
+{
+public:
+	//One instanced draw: instanceCount instances of mesh starting at firstInstance in the array build() wrote
+	struct Batch
+	{
+		uint32_t mesh;
+		uint32_t material;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+
+	InstanceBatcher();
+	~InstanceBatcher();
+
+	//With splitByMaterial off every instance of a mesh lands in one batch and Batch::material is 0
+	void init(bool splitByMaterial);
+
+	void add(uint32_t mesh, uint32_t material, const InstanceData* instances, uint32_t instanceCount);
+	uint32_t getInstanceCount() const { return m_instanceCount; }
+	bool isEmpty() const { return m_instanceCount == 0; }
+
+	//Writes every instance to destination, which must hold getInstanceCount() of them, one group after another, fills
+	//in the batches and starts collecting the next frame
+	void build(InstanceData* destination);
+	const std::vector<Batch>& getBatches() const { return m_batches; }
+
+private:
+	struct Group
+	{
+		uint32_t mesh;
+		uint32_t material;
+		std::vector<InstanceData> instances;
+	};
+
+	bool m_splitByMaterial;
+	std::unordered_map<uint64_t, uint32_t> m_groupIndices;
+	std::vector<Group> m_groups;
+	uint32_t m_instanceCount;
+	std::vector<Batch> m_batches;
+};
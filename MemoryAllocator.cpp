@@ -0,0 +1,368 @@
+#include "MemoryAllocator.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+MemoryAllocator::MemoryAllocator()
+	: m_device(VK_NULL_HANDLE)
+	, m_memoryProperties{}
+	, m_bufferImageGranularity(1)
+	, m_maxMemoryAllocationCount(4096)
+	, m_preferredBlockSize(0)
+	, m_peakBytesReserved(0)
+	, m_deviceMemoryCount(0)
+{
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+}
+
+void MemoryAllocator::init(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize preferredBlockSize)
+{
+	m_device = device;
+	m_preferredBlockSize = preferredBlockSize;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	m_bufferImageGranularity = properties.limits.bufferImageGranularity;
+	m_maxMemoryAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memoryProperties);
+}
+
+void MemoryAllocator::destroy()
+{
+	for (uint32_t i = 0; i < m_blocks.size(); i++)
+	{
+		if (m_blocks[i] && m_blocks[i]->allocationCount > 0)
+		{
+			std::cerr << "MemoryAllocator: block " << i << " still has " << m_blocks[i]->allocationCount << " live allocations at shutdown" << std::endl;
+		}
+		destroyBlock(i);
+	}
+	m_blocks.clear();
+}
+
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linearResource)
+{
+	uint32_t memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+
+	//With a granularity of 1 there is nothing to separate, every resource can share a block
+	bool linear = m_bufferImageGranularity > 1 ? linearResource : true;
+
+	VkDeviceSize blockSize = getBlockSize(memoryTypeIndex);
+	bool dedicated = requirements.size > blockSize / 2;
+
+	MemoryAllocation allocation;
+	allocation.size = requirements.size;
+
+	bool found = false;
+	if (!dedicated)
+	{
+		for (uint32_t i = 0; i < m_blocks.size() && !found; i++)
+		{
+			Block* block = m_blocks[i].get();
+			if (!block || block->dedicated || block->memoryTypeIndex != memoryTypeIndex || block->linear != linear)
+			{
+				continue;
+			}
+
+			if (allocateFromBlock(*block, requirements, allocation.offset))
+			{
+				allocation.blockIndex = i;
+				found = true;
+			}
+		}
+	}
+
+	if (!found)
+	{
+		allocation.blockIndex = createBlock(memoryTypeIndex, dedicated ? requirements.size : blockSize, requirements.size + requirements.alignment, linear, dedicated);
+		if (!allocateFromBlock(*m_blocks[allocation.blockIndex], requirements, allocation.offset))
+		{
+			throw std::runtime_error("failed to sub-allocate from a new memory block!");
+		}
+	}
+
+	Block& block = *m_blocks[allocation.blockIndex];
+	allocation.memory = block.memory;
+	allocation.mappedData = block.mapped ? block.mapped + allocation.offset : nullptr;
+
+	return allocation;
+}
+
+void MemoryAllocator::free(MemoryAllocation& allocation)
+{
+	if (!allocation.isValid())
+	{
+		return;
+	}
+
+	Block& block = *m_blocks[allocation.blockIndex];
+	block.used -= allocation.size;
+	block.allocationCount--;
+
+	if (block.dedicated)
+	{
+		destroyBlock(allocation.blockIndex);
+		allocation = MemoryAllocation{};
+		return;
+	}
+
+	//Insert the range back in offset order and merge it with whichever neighbours it touches
+	FreeRange range = { allocation.offset, allocation.size };
+	auto it = std::lower_bound(block.freeRanges.begin(), block.freeRanges.end(), range,
+		[](const FreeRange& a, const FreeRange& b) { return a.offset < b.offset; });
+	it = block.freeRanges.insert(it, range);
+
+	auto next = it + 1;
+	if (next != block.freeRanges.end() && it->offset + it->size == next->offset)
+	{
+		it->size += next->size;
+		block.freeRanges.erase(next);
+	}
+
+	if (it != block.freeRanges.begin())
+	{
+		auto prev = it - 1;
+		if (prev->offset + prev->size == it->offset)
+		{
+			prev->size += it->size;
+			block.freeRanges.erase(it);
+		}
+	}
+
+	//Keep one empty block per memory type around so a create/destroy loop does not hit vkAllocateMemory every time
+	if (block.allocationCount == 0)
+	{
+		for (uint32_t i = 0; i < m_blocks.size(); i++)
+		{
+			const Block* other = m_blocks[i].get();
+			if (i != allocation.blockIndex && other && !other->dedicated && other->allocationCount == 0 &&
+				other->memoryTypeIndex == block.memoryTypeIndex && other->linear == block.linear)
+			{
+				destroyBlock(allocation.blockIndex);
+				break;
+			}
+		}
+	}
+
+	allocation = MemoryAllocation{};
+}
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+{
+	for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++)
+	{
+		if ((typeFilter & (1 << i)) && (m_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return i;
+		}
+	}
+
+	throw std::runtime_error("failed to find suitable memory type!");
+}
+
+MemoryAllocator::Stats MemoryAllocator::getStats() const
+{
+	Stats stats;
+	for (const auto& block : m_blocks)
+	{
+		if (!block)
+		{
+			continue;
+		}
+
+		stats.blockCount++;
+		stats.dedicatedBlockCount += block->dedicated ? 1 : 0;
+		stats.allocationCount += block->allocationCount;
+		stats.bytesReserved += block->size;
+		stats.bytesUsed += block->used;
+
+		for (const auto& range : block->freeRanges)
+		{
+			stats.bytesFree += range.size;
+			stats.largestFreeRange = (std::max)(stats.largestFreeRange, range.size);
+		}
+	}
+
+	stats.peakBytesReserved = m_peakBytesReserved;
+	if (stats.bytesFree > 0)
+	{
+		stats.fragmentation = 1.0f - static_cast<float>(stats.largestFreeRange) / static_cast<float>(stats.bytesFree);
+	}
+
+	return stats;
+}
+
+void MemoryAllocator::printStats() const
+{
+	Stats stats = getStats();
+	std::cout << "GPU memory: " << stats.blockCount << " blocks (" << stats.dedicatedBlockCount << " dedicated), "
+		<< stats.allocationCount << " allocations, "
+		<< stats.bytesUsed / 1024 << "KiB used of " << stats.bytesReserved / 1024 << "KiB reserved, "
+		<< "peak " << stats.peakBytesReserved / 1024 << "KiB, "
+		<< "fragmentation " << stats.fragmentation * 100.0f << "%" << std::endl;
+}
+
+uint32_t MemoryAllocator::createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceSize minimumSize, bool linear, bool dedicated)
+{
+	if (m_deviceMemoryCount >= m_maxMemoryAllocationCount)
+	{
+		throw std::runtime_error("exceeded maxMemoryAllocationCount!");
+	}
+
+	auto block = std::make_unique<Block>();
+	block->memoryTypeIndex = memoryTypeIndex;
+	block->linear = linear;
+	block->dedicated = dedicated;
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkResult result = vkAllocateMemory(m_device, &allocInfo, nullptr, &block->memory);
+
+	//Small heaps may not fit a full block, retry with smaller sizes rather than failing outright
+	while (result == VK_ERROR_OUT_OF_DEVICE_MEMORY && !dedicated && allocInfo.allocationSize / 2 >= minimumSize)
+	{
+		allocInfo.allocationSize /= 2;
+		result = vkAllocateMemory(m_device, &allocInfo, nullptr, &block->memory);
+	}
+
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate device memory block!");
+	}
+
+	block->size = allocInfo.allocationSize;
+	block->freeRanges.push_back({ 0, block->size });
+
+	if (m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		void* data;
+		if (vkMapMemory(m_device, block->memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS)
+		{
+			vkFreeMemory(m_device, block->memory, nullptr);
+			throw std::runtime_error("failed to map memory block!");
+		}
+		block->mapped = static_cast<char*>(data);
+	}
+
+	m_deviceMemoryCount++;
+
+	uint32_t index = 0;
+	while (index < m_blocks.size() && m_blocks[index])
+	{
+		index++;
+	}
+
+	if (index == m_blocks.size())
+	{
+		m_blocks.push_back(std::move(block));
+	}
+	else
+	{
+		m_blocks[index] = std::move(block);
+	}
+
+	VkDeviceSize reserved = 0;
+	for (const auto& b : m_blocks)
+	{
+		reserved += b ? b->size : 0;
+	}
+	m_peakBytesReserved = (std::max)(m_peakBytesReserved, reserved);
+
+	return index;
+}
+
+void MemoryAllocator::destroyBlock(uint32_t blockIndex)
+{
+	Block* block = m_blocks[blockIndex].get();
+	if (!block)
+	{
+		return;
+	}
+
+	if (block->mapped)
+	{
+		vkUnmapMemory(m_device, block->memory);
+	}
+	vkFreeMemory(m_device, block->memory, nullptr);
+	m_deviceMemoryCount--;
+
+	m_blocks[blockIndex].reset();
+}
+
+//Best fit: pick the free range that leaves the least space over once the request is aligned inside it
+bool MemoryAllocator::allocateFromBlock(Block& block, const VkMemoryRequirements& requirements, VkDeviceSize& offset)
+{
+	auto best = block.freeRanges.end();
+	VkDeviceSize bestWaste = ~0ull;
+
+	for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it)
+	{
+		VkDeviceSize alignedOffset = alignUp(it->offset, requirements.alignment);
+		VkDeviceSize end = it->offset + it->size;
+		if (alignedOffset + requirements.size > end)
+		{
+			continue;
+		}
+
+		VkDeviceSize waste = it->size - requirements.size;
+		if (waste < bestWaste)
+		{
+			best = it;
+			bestWaste = waste;
+		}
+	}
+
+	if (best == block.freeRanges.end())
+	{
+		return false;
+	}
+
+	FreeRange range = *best;
+	offset = alignUp(range.offset, requirements.alignment);
+	VkDeviceSize padding = offset - range.offset;
+	VkDeviceSize tail = range.offset + range.size - (offset + requirements.size);
+
+	//The alignment padding in front stays free as its own range, as does whatever is left behind the allocation
+	if (padding > 0 && tail > 0)
+	{
+		best->size = padding;
+		block.freeRanges.insert(best + 1, { offset + requirements.size, tail });
+	}
+	else if (padding > 0)
+	{
+		best->size = padding;
+	}
+	else if (tail > 0)
+	{
+		best->offset = offset + requirements.size;
+		best->size = tail;
+	}
+	else
+	{
+		block.freeRanges.erase(best);
+	}
+
+	block.used += requirements.size;
+	block.allocationCount++;
+	return true;
+}
+
+VkDeviceSize MemoryAllocator::getBlockSize(uint32_t memoryTypeIndex) const
+{
+	//Never let a single block take more than an eighth of its heap, software and integrated devices can have small heaps
+	uint32_t heapIndex = m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+	VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[heapIndex].size;
+	return (std::min)(m_preferredBlockSize, (std::max)(heapSize / 8, VkDeviceSize(1024 * 1024)));
+}
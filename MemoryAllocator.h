@@ -0,0 +1,90 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory>
+
+//A sub-range of one of the allocator's VkDeviceMemory blocks. Host visible memory is mapped once when its
+//block is created, mappedData then points straight at this allocation's bytes.
+struct MemoryAllocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void* mappedData = nullptr;
+	uint32_t blockIndex = 0;
+
+	bool isValid() const { return memory != VK_NULL_HANDLE; }
+};
+
+//Block based GPU memory allocator. Each memory type gets its own list of large blocks which are carved up with a
+//best-fit free list (free ranges kept sorted by offset and merged on release). Requests bigger than half a block get
+//a dedicated allocation. When bufferImageGranularity is larger than 1, linear resources (buffers, linear images)
+//and optimal-tiling images are kept in separate blocks so neighbouring allocations can never alias a granularity page.
+class MemoryAllocator
+{
+public:
+	struct Stats
+	{
+		uint32_t blockCount = 0;
+		uint32_t dedicatedBlockCount = 0;
+		uint32_t allocationCount = 0;
+		VkDeviceSize bytesReserved = 0;
+		VkDeviceSize bytesUsed = 0;
+		VkDeviceSize bytesFree = 0;
+		VkDeviceSize largestFreeRange = 0;
+		VkDeviceSize peakBytesReserved = 0;
+
+		//0 when all free space is one contiguous range, approaching 1 as it splinters into small pieces
+		float fragmentation = 0.0f;
+	};
+
+	MemoryAllocator();
+	~MemoryAllocator();
+
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize preferredBlockSize = 64ull * 1024 * 1024);
+	void destroy();
+
+	MemoryAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linearResource);
+	void free(MemoryAllocation& allocation);
+
+	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+	Stats getStats() const;
+	void printStats() const;
+
+private:
+	struct FreeRange
+	{
+		VkDeviceSize offset;
+		VkDeviceSize size;
+	};
+
+	struct Block
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		VkDeviceSize used = 0;
+		uint32_t memoryTypeIndex = 0;
+		uint32_t allocationCount = 0;
+		bool linear = true;
+		bool dedicated = false;
+		char* mapped = nullptr;
+		std::vector<FreeRange> freeRanges;
+	};
+
+	uint32_t createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceSize minimumSize, bool linear, bool dedicated);
+	void destroyBlock(uint32_t blockIndex);
+	bool allocateFromBlock(Block& block, const VkMemoryRequirements& requirements, VkDeviceSize& offset);
+	VkDeviceSize getBlockSize(uint32_t memoryTypeIndex) const;
+
+	VkDevice m_device;
+	VkPhysicalDeviceMemoryProperties m_memoryProperties;
+	VkDeviceSize m_bufferImageGranularity;
+	uint32_t m_maxMemoryAllocationCount;
+	VkDeviceSize m_preferredBlockSize;
+	VkDeviceSize m_peakBytesReserved;
+	uint32_t m_deviceMemoryCount;
+
+	//Freed slots are left null and reused so that MemoryAllocation::blockIndex stays stable
+	std::vector<std::unique_ptr<Block>> m_blocks;
+};
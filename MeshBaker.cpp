@@ -0,0 +1,268 @@
+#include "MeshBaker.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+
+//OBJ corners index positions, texture coordinates and normals separately, a vertex is one distinct triple
+struct CornerKey
+{
+	int position;
+	int texCoord;
+	int normal;
+
+	bool operator==(const CornerKey& other) const
+	{
+		return position == other.position && texCoord == other.texCoord && normal == other.normal;
+	}
+};
+
+struct CornerKeyHash
+{
+	size_t operator()(const CornerKey& key) const
+	{
+		uint64_t packed = static_cast<uint64_t>(static_cast<uint32_t>(key.position)) << 32 | static_cast<uint32_t>(key.texCoord);
+		return std::hash<uint64_t>()(packed * 31 + static_cast<uint32_t>(key.normal));
+	}
+};
+
+MeshData MeshBaker::importObj(const std::string& path)
+{
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string warning;
+	std::string error;
+
+	std::string baseDirectory = std::filesystem::path(path).parent_path().string();
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warning, &error, path.c_str(), baseDirectory.empty() ? nullptr : baseDirectory.c_str()))
+	{
+		throw std::runtime_error("failed to load mesh " + path + ": " + warning + error);
+	}
+
+	//Triangles are bucketed by material first, so each material's submesh is one contiguous index range
+	size_t materialCount = (std::max)(materials.size(), static_cast<size_t>(1));
+	std::vector<std::vector<uint32_t>> buckets(materialCount);
+
+	//Vertices are only shared within a material, its diffuse colour is baked into them
+	MeshData mesh;
+	std::vector<std::unordered_map<CornerKey, uint32_t, CornerKeyHash>> uniqueVertices(materialCount);
+	std::vector<bool> generateNormals;
+
+	for (const tinyobj::shape_t& shape : shapes)
+	{
+		for (size_t corner = 0; corner < shape.mesh.indices.size(); corner++)
+		{
+			const tinyobj::index_t& index = shape.mesh.indices[corner];
+			int materialId = shape.mesh.material_ids.empty() ? -1 : shape.mesh.material_ids[corner / 3];
+			uint32_t material = materialId >= 0 && static_cast<size_t>(materialId) < materialCount ? static_cast<uint32_t>(materialId) : 0;
+
+			CornerKey key{ index.vertex_index, index.texcoord_index, index.normal_index };
+			auto found = uniqueVertices[material].find(key);
+			if (found != uniqueVertices[material].end())
+			{
+				buckets[material].push_back(found->second);
+				continue;
+			}
+
+			Vertex vertex{};
+			const float* position = &attrib.vertices[3 * static_cast<size_t>(index.vertex_index)];
+			vertex.pos = { position[0], position[1], position[2] };
+
+			vertex.color = glm::vec3(1.0f);
+			if (attrib.colors.size() >= attrib.vertices.size())
+			{
+				const float* color = &attrib.colors[3 * static_cast<size_t>(index.vertex_index)];
+				vertex.color = { color[0], color[1], color[2] };
+			}
+			if (!materials.empty())
+			{
+				const float* diffuse = materials[material].diffuse;
+				vertex.color *= glm::vec3(diffuse[0], diffuse[1], diffuse[2]);
+			}
+
+			//OBJ puts v = 0 at the bottom of the image, Vulkan samples row 0 first
+			if (index.texcoord_index >= 0)
+			{
+				const float* texCoord = &attrib.texcoords[2 * static_cast<size_t>(index.texcoord_index)];
+				vertex.texCoord = { texCoord[0], 1.0f - texCoord[1] };
+			}
+
+			vertex.normal = glm::vec3(0.0f);
+			if (index.normal_index >= 0)
+			{
+				const float* normal = &attrib.normals[3 * static_cast<size_t>(index.normal_index)];
+				vertex.normal = { normal[0], normal[1], normal[2] };
+			}
+
+			uint32_t vertexIndex = static_cast<uint32_t>(mesh.vertices.size());
+			mesh.vertices.push_back(vertex);
+			generateNormals.push_back(index.normal_index < 0);
+			uniqueVertices[material].emplace(key, vertexIndex);
+			buckets[material].push_back(vertexIndex);
+		}
+	}
+
+	for (uint32_t material = 0; material < materialCount; material++)
+	{
+		if (buckets[material].empty())
+		{
+			continue;
+		}
+
+		Submesh submesh{};
+		submesh.firstIndex = static_cast<uint32_t>(mesh.indices.size());
+		submesh.indexCount = static_cast<uint32_t>(buckets[material].size());
+		submesh.materialIndex = material;
+		mesh.indices.insert(mesh.indices.end(), buckets[material].begin(), buckets[material].end());
+		mesh.submeshes.push_back(submesh);
+	}
+
+	if (mesh.indices.empty())
+	{
+		throw std::runtime_error("failed to load mesh " + path + ": no triangles");
+	}
+
+	//Area weighted face normals summed into every corner the file gave no normal, which can be some faces of a file
+	//that has normals too. Corners only share a vertex when their position and texture coordinate match, so UV seams
+	//keep a crease
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		const uint32_t corners[] = { mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2] };
+		const Vertex& a = mesh.vertices[corners[0]];
+		const Vertex& b = mesh.vertices[corners[1]];
+		const Vertex& c = mesh.vertices[corners[2]];
+		glm::vec3 faceNormal = glm::cross(b.pos - a.pos, c.pos - a.pos);
+		for (uint32_t corner : corners)
+		{
+			if (generateNormals[corner])
+			{
+				mesh.vertices[corner].normal += faceNormal;
+			}
+		}
+	}
+	for (size_t vertex = 0; vertex < mesh.vertices.size(); vertex++)
+	{
+		if (generateNormals[vertex])
+		{
+			glm::vec3& normal = mesh.vertices[vertex].normal;
+			float length = glm::length(normal);
+			normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+		}
+	}
+
+	for (Submesh& submesh : mesh.submeshes)
+	{
+		submesh.bounds = computeBounds(mesh, submesh.firstIndex, submesh.indexCount);
+	}
+	mesh.bounds = computeBounds(mesh, 0, static_cast<uint32_t>(mesh.indices.size()));
+
+	return mesh;
+}
+
+MeshBaker::OptimizeStats MeshBaker::optimize(MeshData& mesh, bool reduceOverdraw)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	OptimizeStats stats;
+	stats.before = MeshOptimizer::analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+
+	//Submeshes are drawn as separate ranges, so triangles never move between them
+	for (const Submesh& submesh : mesh.submeshes)
+	{
+		uint32_t* indices = mesh.indices.data() + submesh.firstIndex;
+		std::vector<uint32_t> clusters = MeshOptimizer::optimizeVertexCache(indices, submesh.indexCount, mesh.vertices.size());
+		if (reduceOverdraw)
+		{
+			MeshOptimizer::optimizeOverdraw(indices, submesh.indexCount, mesh.vertices, clusters);
+		}
+	}
+	MeshOptimizer::optimizeVertexFetch(mesh);
+
+	stats.after = MeshOptimizer::analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+	stats.optimizeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
+
+std::string MeshBaker::bake(const std::string& sourcePath, const Options& options)
+{
+	std::filesystem::path source(sourcePath);
+	if (source.extension() == ".mesh")
+	{
+		return sourcePath;
+	}
+
+	std::string bakedPath = sourcePath + (options.packedVertices ? ".packed.mesh" : ".mesh");
+	uint32_t optimizations = 0;
+	if (options.optimize)
+	{
+		optimizations = MeshFile::s_vertexCacheOptimized | (options.reduceOverdraw ? MeshFile::s_overdrawOptimized : 0);
+	}
+
+	//One error code per call, a failed timestamp must not be cleared by the next call succeeding
+	std::error_code existsError;
+	std::error_code bakedTimeError;
+	std::error_code sourceTimeError;
+	bool upToDate = false;
+	if (std::filesystem::exists(bakedPath, existsError))
+	{
+		auto bakedTime = std::filesystem::last_write_time(bakedPath, bakedTimeError);
+		auto sourceTime = std::filesystem::last_write_time(source, sourceTimeError);
+		upToDate = !bakedTimeError && !sourceTimeError && bakedTime >= sourceTime;
+	}
+	if (upToDate)
+	{
+		//Bakes from an older format or Vertex layout are rebuilt rather than rejected at load time
+		try
+		{
+			MeshFile baked;
+			baked.open(bakedPath);
+			if (baked.isPacked() == options.packedVertices && baked.getOptimizations() == optimizations)
+			{
+				return bakedPath;
+			}
+		}
+		catch (const std::exception& exception)
+		{
+			std::cout << "Mesh baker: rebaking, " << exception.what() << std::endl;
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	MeshData mesh = importObj(sourcePath);
+	OptimizeStats stats;
+	if (options.optimize)
+	{
+		stats = optimize(mesh, options.reduceOverdraw);
+	}
+	MeshFile::write(bakedPath, mesh, options.packedVertices, optimizations);
+	double bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "Mesh baker: " << sourcePath << " -> " << bakedPath << ", " << mesh.indices.size() / 3 << " triangles, "
+		<< mesh.vertices.size() << " vertices, " << mesh.submeshes.size() << " submeshes in " << bakeMs << "ms" << std::endl;
+	if (options.optimize)
+	{
+		std::cout << "Mesh baker: ACMR " << stats.before.acmr << " -> " << stats.after.acmr << ", ATVR " << stats.before.atvr << " -> "
+			<< stats.after.atvr << (options.reduceOverdraw ? ", overdraw ordered" : "") << " in " << stats.optimizeMs << "ms" << std::endl;
+	}
+	return bakedPath;
+}
+
+MeshBounds MeshBaker::computeBounds(const MeshData& mesh, uint32_t firstIndex, uint32_t indexCount)
+{
+	MeshBounds bounds{ glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+	for (uint32_t i = firstIndex; i < firstIndex + indexCount; i++)
+	{
+		const glm::vec3& position = mesh.vertices[mesh.indices[i]].pos;
+		bounds.min = glm::min(bounds.min, position);
+		bounds.max = glm::max(bounds.max, position);
+	}
+	return bounds;
+}
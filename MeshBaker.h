@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+
+//Turns source assets into MeshFile bakes. Text formats are only ever parsed here, once per asset; the renderer maps
+//the baked file. Wavefront OBJ is the supported source format.
+class MeshBaker
+{
+public:
+	struct Options
+	{
+		bool packedVertices = false;
+		//Vertex cache and vertex fetch ordering, overdraw ordering on top when reduceOverdraw is also set
+		bool optimize = true;
+		bool reduceOverdraw = false;
+	};
+
+	struct OptimizeStats
+	{
+		MeshOptimizer::CacheStats before;
+		MeshOptimizer::CacheStats after;
+		double optimizeMs = 0.0;
+	};
+
+	//Parses an OBJ with tinyobjloader. Faces are triangulated, corners sharing a position, texture coordinate and
+	//normal become one vertex, and each material gets a submesh. Vertex colours are the OBJ vertex colours tinted by
+	//the material's diffuse colour. Corners without normals get smooth ones from the faces. Throws if the file cannot
+	//be parsed
+	static MeshData importObj(const std::string& path);
+
+	//Runs the MeshOptimizer passes over every submesh, then reorders the vertices for fetch
+	static OptimizeStats optimize(MeshData& mesh, bool reduceOverdraw);
+
+	//Returns the baked file for sourcePath, baking it to sourcePath + ".mesh" (".packed.mesh" for packed vertices)
+	//first unless that exists, is newer than the source and still loads with the requested options. Paths that are
+	//already .mesh files are returned unchanged
+	static std::string bake(const std::string& sourcePath, const Options& options);
+
+	static MeshBounds computeBounds(const MeshData& mesh, uint32_t firstIndex, uint32_t indexCount);
+};
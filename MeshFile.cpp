@@ -0,0 +1,256 @@
+#include "MeshFile.h"
+
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t alignSection(uint64_t offset, uint64_t alignment)
+{
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+MeshFile::MeshFile()
+	: m_data(nullptr)
+	, m_size(0)
+#ifdef _WIN32
+	, m_file(INVALID_HANDLE_VALUE)
+	, m_mapping(nullptr)
+#else
+	, m_file(-1)
+#endif
+{
+}
+
+MeshFile::~MeshFile()
+{
+	close();
+}
+
+void MeshFile::open(const std::string& path)
+{
+	close();
+
+#ifdef _WIN32
+	m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	LARGE_INTEGER fileSize{};
+	if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &fileSize))
+	{
+		close();
+		throw std::runtime_error("failed to open mesh " + path + "!");
+	}
+	m_size = static_cast<size_t>(fileSize.QuadPart);
+
+	m_mapping = m_size > 0 ? CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	m_data = m_mapping != nullptr ? static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+	m_file = ::open(path.c_str(), O_RDONLY);
+	struct stat fileStat{};
+	if (m_file < 0 || fstat(m_file, &fileStat) != 0)
+	{
+		close();
+		throw std::runtime_error("failed to open mesh " + path + "!");
+	}
+	m_size = static_cast<size_t>(fileStat.st_size);
+
+	void* mapped = m_size > 0 ? mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0) : MAP_FAILED;
+	if (mapped != MAP_FAILED)
+	{
+		//The streams are read front to back exactly once
+		madvise(mapped, m_size, MADV_SEQUENTIAL);
+		m_data = static_cast<const char*>(mapped);
+	}
+#endif
+
+	if (m_data == nullptr)
+	{
+		close();
+		throw std::runtime_error("failed to map mesh " + path + "!");
+	}
+
+	std::string reason;
+	if (!validate(reason))
+	{
+		close();
+		throw std::runtime_error("failed to load mesh " + path + ", " + reason + "!");
+	}
+}
+
+void MeshFile::close()
+{
+#ifdef _WIN32
+	if (m_data != nullptr)
+	{
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping != nullptr)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (m_data != nullptr)
+	{
+		munmap(const_cast<char*>(m_data), m_size);
+	}
+	if (m_file >= 0)
+	{
+		::close(m_file);
+		m_file = -1;
+	}
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
+
+void MeshFile::write(const std::string& path, const MeshData& mesh, bool packedVertices, uint32_t optimizations)
+{
+	//Texture coordinates that do not fit snorm16 are mapped onto [-1, 1] as a whole, keeping the most precision the
+	//range allows, and the vertex shader maps them back
+	glm::vec4 texCoordTransform(1.0f, 1.0f, 0.0f, 0.0f);
+	std::vector<PackedVertex> packed;
+	if (packedVertices && !mesh.vertices.empty())
+	{
+		glm::vec2 minTexCoord = mesh.vertices[0].texCoord;
+		glm::vec2 maxTexCoord = minTexCoord;
+		for (const Vertex& vertex : mesh.vertices)
+		{
+			minTexCoord = glm::min(minTexCoord, vertex.texCoord);
+			maxTexCoord = glm::max(maxTexCoord, vertex.texCoord);
+		}
+		if (glm::any(glm::lessThan(minTexCoord, glm::vec2(-1.0f))) || glm::any(glm::greaterThan(maxTexCoord, glm::vec2(1.0f))))
+		{
+			glm::vec2 scale = glm::max((maxTexCoord - minTexCoord) * 0.5f, glm::vec2(1e-6f));
+			texCoordTransform = glm::vec4(scale, (minTexCoord + maxTexCoord) * 0.5f);
+		}
+
+		packed.reserve(mesh.vertices.size());
+		for (Vertex vertex : mesh.vertices)
+		{
+			vertex.texCoord = (vertex.texCoord - glm::vec2(texCoordTransform.z, texCoordTransform.w)) / glm::vec2(texCoordTransform.x, texCoordTransform.y);
+			packed.push_back(packVertex(vertex));
+		}
+	}
+	const void* vertexData = packedVertices ? static_cast<const void*>(packed.data()) : mesh.vertices.data();
+
+	std::vector<uint16_t> narrowIndices;
+	if (mesh.vertices.size() <= 0x10000)
+	{
+		narrowIndices.reserve(mesh.indices.size());
+		for (uint32_t index : mesh.indices)
+		{
+			narrowIndices.push_back(static_cast<uint16_t>(index));
+		}
+	}
+	const void* indexData = narrowIndices.empty() ? static_cast<const void*>(mesh.indices.data()) : narrowIndices.data();
+
+	Header header{};
+	header.magic = s_magic;
+	header.version = s_version;
+	header.vertexStride = packedVertices ? sizeof(PackedVertex) : sizeof(Vertex);
+	header.indexSize = narrowIndices.empty() ? sizeof(uint32_t) : sizeof(uint16_t);
+	header.packedVertices = packedVertices ? 1 : 0;
+	header.optimizations = optimizations;
+	header.vertexCount = mesh.vertices.size();
+	header.indexCount = mesh.indices.size();
+	header.submeshCount = mesh.submeshes.size();
+	header.bounds = mesh.bounds;
+	header.texCoordTransform = texCoordTransform;
+
+	header.submeshOffset = alignSection(sizeof(Header), s_sectionAlignment);
+	header.vertexOffset = alignSection(header.submeshOffset + header.submeshCount * sizeof(Submesh), s_sectionAlignment);
+	header.indexOffset = alignSection(header.vertexOffset + header.vertexCount * header.vertexStride, s_sectionAlignment);
+	uint64_t fileSize = header.indexOffset + header.indexCount * header.indexSize;
+
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("failed to open " + tempPath + "!");
+		}
+
+		auto writeSection = [&file](uint64_t offset, const void* data, uint64_t size) {
+			static const char zeros[s_sectionAlignment] = {};
+			file.write(zeros, static_cast<std::streamsize>(offset - static_cast<uint64_t>(file.tellp())));
+			file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		};
+		writeSection(0, &header, sizeof(header));
+		writeSection(header.submeshOffset, mesh.submeshes.data(), header.submeshCount * sizeof(Submesh));
+		writeSection(header.vertexOffset, vertexData, header.vertexCount * header.vertexStride);
+		writeSection(header.indexOffset, indexData, header.indexCount * header.indexSize);
+		file.flush();
+
+		if (!file.good() || static_cast<uint64_t>(file.tellp()) != fileSize)
+		{
+			throw std::runtime_error("failed to write " + tempPath + "!");
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+	if (error)
+	{
+		std::filesystem::remove(tempPath, error);
+		throw std::runtime_error("failed to replace " + path + "!");
+	}
+}
+
+bool MeshFile::validate(std::string& reason) const
+{
+	if (m_size < sizeof(Header))
+	{
+		reason = "file truncated";
+		return false;
+	}
+
+	const Header& header = getHeader();
+	if (header.magic != s_magic || header.version != s_version)
+	{
+		reason = "unknown file format";
+		return false;
+	}
+
+	if (header.vertexStride != (header.packedVertices ? sizeof(PackedVertex) : sizeof(Vertex)) || (header.indexSize != sizeof(uint16_t) && header.indexSize != sizeof(uint32_t)))
+	{
+		reason = "baked for a different vertex layout";
+		return false;
+	}
+
+	//Every section has to lie inside the mapping, and the counts are checked before they are multiplied
+	auto fits = [this](uint64_t offset, uint64_t count, uint64_t elementSize) {
+		return offset % s_sectionAlignment == 0 && offset <= m_size && count <= (m_size - offset) / elementSize;
+	};
+	if (!fits(header.submeshOffset, header.submeshCount, sizeof(Submesh)) || !fits(header.vertexOffset, header.vertexCount, header.vertexStride) ||
+		!fits(header.indexOffset, header.indexCount, header.indexSize))
+	{
+		reason = "file truncated";
+		return false;
+	}
+
+	const Submesh* submeshes = getSubmeshes();
+	for (uint64_t i = 0; i < header.submeshCount; i++)
+	{
+		if (submeshes[i].firstIndex > header.indexCount || submeshes[i].indexCount > header.indexCount - submeshes[i].firstIndex)
+		{
+			reason = "submesh outside the index stream";
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "vertex.h"
+
+struct MeshBounds
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+//A range of the index stream drawn with one material of the source file
+struct Submesh
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	//Index into the source file's material list, 0 when it has none
+	uint32_t materialIndex;
+	uint32_t padding;
+	MeshBounds bounds;
+};
+
+//A mesh as it is imported: full precision vertices and 32-bit indices. Baking can pack the vertices
+struct MeshData
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<Submesh> submeshes;
+	MeshBounds bounds;
+};
+
+//Pre-baked binary mesh, read by memory-mapping the file. The layout is a Header, then the submesh table, the vertex
+//stream and the index stream, each section starting on a 16 byte boundary. The streams are stored exactly as they are
+//uploaded, so loading is a validation of the header followed by copies from the mapping into the staging ring.
+//The vertex stream holds either Vertex or PackedVertex structs. Files written with a different layout of those or
+//another format version are rejected and have to be baked again.
+class MeshFile
+{
+public:
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vertexStride;
+		uint32_t indexSize;
+		uint32_t packedVertices;
+		uint32_t optimizations;
+		uint64_t vertexCount;
+		uint64_t indexCount;
+		uint64_t submeshCount;
+		uint64_t submeshOffset;
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+		MeshBounds bounds;
+		//Packed texture coordinates decode to stored * xy + zw, see getTexCoordTransform()
+		glm::vec4 texCoordTransform;
+	};
+
+	static const uint32_t s_magic = 0x534D4B56; // "VKMS"
+	static const uint32_t s_version = 4;
+
+	//Header::optimizations bits, which MeshOptimizer passes the bake went through
+	static const uint32_t s_vertexCacheOptimized = 1;
+	static const uint32_t s_overdrawOptimized = 2;
+
+	MeshFile();
+	~MeshFile();
+
+	//Throws if the file cannot be mapped or was not baked for the current format and Vertex layout
+	void open(const std::string& path);
+	void close();
+
+	//Writes to a temporary file and renames it over path, so a reader never maps a half written mesh. Indices are
+	//stored in 16 bits whenever every vertex can be addressed with them. Packed vertices store texture coordinates as
+	//snorm16; a mesh with any outside [-1, 1] (tiling UVs) has them remapped into that range by the header's transform
+	static void write(const std::string& path, const MeshData& mesh, bool packedVertices, uint32_t optimizations);
+
+	bool isOpen() const { return m_data != nullptr; }
+	bool isPacked() const { return getHeader().packedVertices != 0; }
+	uint32_t getOptimizations() const { return getHeader().optimizations; }
+	//Scale in xy and offset in zw the vertex shader applies to texture coordinates, identity unless they were remapped
+	const glm::vec4& getTexCoordTransform() const { return getHeader().texCoordTransform; }
+	const Header& getHeader() const { return *reinterpret_cast<const Header*>(m_data); }
+	const Submesh* getSubmeshes() const { return reinterpret_cast<const Submesh*>(m_data + getHeader().submeshOffset); }
+	const void* getVertexData() const { return m_data + getHeader().vertexOffset; }
+	const void* getIndexData() const { return m_data + getHeader().indexOffset; }
+	uint64_t getVertexDataSize() const { return getHeader().vertexCount * getHeader().vertexStride; }
+	uint64_t getIndexDataSize() const { return getHeader().indexCount * getHeader().indexSize; }
+	size_t getFileSize() const { return m_size; }
+
+private:
+	static const uint64_t s_sectionAlignment = 16;
+
+	bool validate(std::string& reason) const;
+
+	const char* m_data;
+	size_t m_size;
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#else
+	int m_file;
+#endif
+};
@@ -0,0 +1,261 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+
+std::vector<uint32_t> MeshOptimizer::optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+	std::vector<uint32_t> clusters;
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return clusters;
+	}
+
+	//Triangles around each vertex, and how many of them are still waiting to be emitted
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		liveTriangles[indices[i]]++;
+	}
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t vertex = 0; vertex < vertexCount; vertex++)
+	{
+		adjacencyOffsets[vertex + 1] = adjacencyOffsets[vertex] + liveTriangles[vertex];
+	}
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	//A vertex is in the simulated cache while fewer than cacheSize vertices have entered since its own timestamp
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	uint32_t timestamp = cacheSize + 1;
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnds;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	output.reserve(triangleCount * 3);
+	size_t cursor = 0;
+
+	clusters.push_back(0);
+	int64_t fanning = indices[0];
+	while (fanning >= 0)
+	{
+		//Emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (uint32_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++)
+		{
+			uint32_t triangle = adjacency[a];
+			if (emitted[triangle])
+			{
+				continue;
+			}
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				uint32_t vertex = indices[triangle * 3 + corner];
+				output.push_back(vertex);
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+				if (timestamp - cacheTime[vertex] > cacheSize)
+				{
+					cacheTime[vertex] = timestamp++;
+				}
+			}
+			emitted[triangle] = true;
+		}
+
+		//Continue from the oldest candidate that will still be cached after its own remaining triangles are emitted
+		int64_t next = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t vertex : candidates)
+		{
+			if (liveTriangles[vertex] == 0)
+			{
+				continue;
+			}
+			int64_t priority = 0;
+			if (timestamp - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+			{
+				priority = timestamp - cacheTime[vertex];
+			}
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = vertex;
+			}
+		}
+
+		//Dead end: back up to a recently used vertex, or failing that scan for any vertex with triangles left
+		if (next < 0)
+		{
+			while (!deadEnds.empty() && next < 0)
+			{
+				uint32_t vertex = deadEnds.back();
+				deadEnds.pop_back();
+				if (liveTriangles[vertex] > 0)
+				{
+					next = vertex;
+				}
+			}
+			while (next < 0 && cursor < vertexCount)
+			{
+				if (liveTriangles[cursor] > 0)
+				{
+					next = static_cast<int64_t>(cursor);
+				}
+				cursor++;
+			}
+			if (next >= 0)
+			{
+				clusters.push_back(static_cast<uint32_t>(output.size() / 3));
+			}
+		}
+		fanning = next;
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+	return clusters;
+}
+
+void MeshOptimizer::optimizeOverdraw(uint32_t* indices, size_t indexCount, const std::vector<Vertex>& vertices, std::vector<uint32_t> clusters,
+	uint32_t cacheSize)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	std::vector<uint32_t> cacheTime(vertices.size(), 0);
+	uint32_t timestamp = cacheSize + 1;
+	for (size_t triangle = 0; triangle < triangleCount; triangle++)
+	{
+		uint32_t misses = 0;
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			uint32_t vertex = indices[triangle * 3 + corner];
+			if (timestamp - cacheTime[vertex] > cacheSize)
+			{
+				cacheTime[vertex] = timestamp++;
+				misses++;
+			}
+		}
+		if (misses == 3)
+		{
+			clusters.push_back(static_cast<uint32_t>(triangle));
+		}
+	}
+	clusters.push_back(0);
+	std::sort(clusters.begin(), clusters.end());
+	clusters.erase(std::unique(clusters.begin(), clusters.end()), clusters.end());
+
+	//Area weighted centroid and normal of every cluster, and of the whole range
+	struct Cluster
+	{
+		uint32_t firstTriangle;
+		uint32_t triangleCount;
+		glm::vec3 centroid;
+		glm::vec3 normal;
+		float sortKey;
+	};
+	std::vector<Cluster> sorted;
+	glm::vec3 rangeCentroid(0.0f);
+	float rangeArea = 0.0f;
+	for (size_t clusterIndex = 0; clusterIndex < clusters.size(); clusterIndex++)
+	{
+		Cluster cluster{};
+		cluster.firstTriangle = clusters[clusterIndex];
+		cluster.triangleCount = static_cast<uint32_t>((clusterIndex + 1 < clusters.size() ? clusters[clusterIndex + 1] : triangleCount) - cluster.firstTriangle);
+		cluster.centroid = glm::vec3(0.0f);
+		cluster.normal = glm::vec3(0.0f);
+
+		float area = 0.0f;
+		for (uint32_t triangle = cluster.firstTriangle; triangle < cluster.firstTriangle + cluster.triangleCount; triangle++)
+		{
+			const glm::vec3& a = vertices[indices[triangle * 3]].pos;
+			const glm::vec3& b = vertices[indices[triangle * 3 + 1]].pos;
+			const glm::vec3& c = vertices[indices[triangle * 3 + 2]].pos;
+			glm::vec3 faceNormal = glm::cross(b - a, c - a);
+			float faceArea = glm::length(faceNormal);
+			cluster.centroid += (a + b + c) * (faceArea / 3.0f);
+			cluster.normal += faceNormal;
+			area += faceArea;
+		}
+		rangeCentroid += cluster.centroid;
+		rangeArea += area;
+		cluster.centroid = area > 0.0f ? cluster.centroid / area : cluster.centroid;
+		sorted.push_back(cluster);
+	}
+	rangeCentroid = rangeArea > 0.0f ? rangeCentroid / rangeArea : rangeCentroid;
+
+	//Clusters facing away from the middle of the mesh are the ones most likely to occlude the rest
+	for (Cluster& cluster : sorted)
+	{
+		float length = glm::length(cluster.normal);
+		cluster.sortKey = length > 0.0f ? glm::dot(cluster.centroid - rangeCentroid, cluster.normal / length) : 0.0f;
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<uint32_t> output;
+	output.reserve(triangleCount * 3);
+	for (const Cluster& cluster : sorted)
+	{
+		output.insert(output.end(), indices + cluster.firstTriangle * 3, indices + (cluster.firstTriangle + cluster.triangleCount) * 3);
+	}
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void MeshOptimizer::optimizeVertexFetch(MeshData& mesh)
+{
+	std::vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+	std::vector<Vertex> vertices;
+	vertices.reserve(mesh.vertices.size());
+
+	for (uint32_t& index : mesh.indices)
+	{
+		if (remap[index] == UINT32_MAX)
+		{
+			remap[index] = static_cast<uint32_t>(vertices.size());
+			vertices.push_back(mesh.vertices[index]);
+		}
+		index = remap[index];
+	}
+	mesh.vertices.swap(vertices);
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+	CacheStats stats;
+	if (indexCount < 3)
+	{
+		return stats;
+	}
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<bool> referenced(vertexCount, false);
+	uint32_t timestamp = cacheSize + 1;
+	size_t misses = 0;
+	size_t uniqueVertices = 0;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		uint32_t vertex = indices[i];
+		if (timestamp - cacheTime[vertex] > cacheSize)
+		{
+			cacheTime[vertex] = timestamp++;
+			misses++;
+		}
+		if (!referenced[vertex])
+		{
+			referenced[vertex] = true;
+			uniqueVertices++;
+		}
+	}
+
+	stats.acmr = static_cast<double>(misses) / (indexCount / 3);
+	stats.atvr = static_cast<double>(misses) / uniqueVertices;
+	return stats;
+}
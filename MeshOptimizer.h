@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "MeshFile.h"
+
+//CPU reordering passes run while baking, so the GPU sees meshes in an order that suits it rather than whatever the
+//exporter wrote. Index passes work on one submesh's range of a MeshData index buffer at a time.
+class MeshOptimizer
+{
+public:
+	//Average cache miss ratio (transformed vertices per triangle, 0.5 is ideal for a regular grid, 3 the worst) and
+	//average transform to vertex ratio (1 is ideal) of a simulated FIFO post-transform cache
+	struct CacheStats
+	{
+		double acmr = 0.0;
+		double atvr = 0.0;
+	};
+
+	static const uint32_t s_cacheSize = 16;
+
+	//Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007).
+	//Reorders triangles in place and returns the offsets, in triangles, where it had to jump to a new area of the
+	//mesh; those are the cluster boundaries optimizeOverdraw works with
+	static std::vector<uint32_t> optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = s_cacheSize);
+
+	//Reorders clusters of a vertex cache optimised range so outward facing parts of the mesh tend to be drawn first.
+	//Clusters are split further wherever a triangle misses the cache on all three vertices, which costs nothing in
+	//cache efficiency
+	static void optimizeOverdraw(uint32_t* indices, size_t indexCount, const std::vector<Vertex>& vertices, std::vector<uint32_t> clusters,
+		uint32_t cacheSize = s_cacheSize);
+
+	//Renumbers vertices in order of first use and drops unreferenced ones, so vertex fetch walks the buffer forwards
+	static void optimizeVertexFetch(MeshData& mesh);
+
+	static CacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = s_cacheSize);
+};
@@ -0,0 +1,244 @@
+#include "PipelineCache.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+
+PipelineCache::PipelineCache()
+	: m_device(VK_NULL_HANDLE)
+	, m_deviceProperties{}
+	, m_pipelineCache(VK_NULL_HANDLE)
+	, m_loadedBytes(0)
+	, m_loadTimeMs(0.0)
+	, m_saveTimeMs(0.0)
+{
+}
+
+PipelineCache::~PipelineCache()
+{
+}
+
+void PipelineCache::load(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	m_device = device;
+	m_path = path;
+	vkGetPhysicalDeviceProperties(physicalDevice, &m_deviceProperties);
+
+	std::vector<char> file;
+	std::string reason;
+	const void* initialData = nullptr;
+	size_t initialDataSize = 0;
+
+	if (m_path.empty())
+	{
+		reason = "persistence disabled";
+	}
+	else if (!readFile(file))
+	{
+		reason = "no cache file";
+	}
+	else if (validate(file, reason))
+	{
+		initialData = file.data() + sizeof(FileHeader);
+		initialDataSize = file.size() - sizeof(FileHeader);
+	}
+
+	VkPipelineCacheCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = initialDataSize;
+	createInfo.pInitialData = initialData;
+
+	VkResult result = vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_pipelineCache);
+
+	//A driver is still allowed to reject data that passed our checks, fall back to an empty cache
+	if (result != VK_SUCCESS && initialDataSize > 0)
+	{
+		reason = "rejected by driver";
+		initialDataSize = 0;
+		createInfo.initialDataSize = 0;
+		createInfo.pInitialData = nullptr;
+		result = vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_pipelineCache);
+	}
+
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+
+	m_loadedBytes = initialDataSize;
+	m_loadTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if (isWarm())
+	{
+		std::cout << "Pipeline cache: loaded " << m_loadedBytes << " bytes from " << m_path << " in " << m_loadTimeMs << "ms (warm)" << std::endl;
+	}
+	else
+	{
+		std::cout << "Pipeline cache: starting empty, " << reason << " (cold) in " << m_loadTimeMs << "ms" << std::endl;
+	}
+}
+
+//Writes to a temporary file first and renames it over the old one, so a crash mid-write never leaves a torn cache behind
+void PipelineCache::save()
+{
+	if (m_pipelineCache == VK_NULL_HANDLE || m_path.empty())
+	{
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(m_device, m_pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+	{
+		std::cerr << "Pipeline cache: nothing to save" << std::endl;
+		return;
+	}
+
+	std::vector<char> data(dataSize);
+	if (vkGetPipelineCacheData(m_device, m_pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+	{
+		std::cerr << "Pipeline cache: failed to read cache data" << std::endl;
+		return;
+	}
+
+	FileHeader header{};
+	header.magic = s_magic;
+	header.version = s_version;
+	header.vendorID = m_deviceProperties.vendorID;
+	header.deviceID = m_deviceProperties.deviceID;
+	header.driverVersion = m_deviceProperties.driverVersion;
+	memcpy(header.pipelineCacheUUID, m_deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = dataSize;
+	header.checksum = checksum(data.data(), dataSize);
+
+	std::string tempPath = m_path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			std::cerr << "Pipeline cache: failed to open " << tempPath << std::endl;
+			return;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(data.data(), dataSize);
+		file.flush();
+
+		if (!file.good())
+		{
+			std::cerr << "Pipeline cache: failed to write " << tempPath << std::endl;
+			return;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, m_path, error);
+	if (error)
+	{
+		std::cerr << "Pipeline cache: failed to replace " << m_path << ": " << error.message() << std::endl;
+		std::filesystem::remove(tempPath, error);
+		return;
+	}
+
+	m_saveTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Pipeline cache: saved " << dataSize << " bytes to " << m_path << " in " << m_saveTimeMs << "ms" << std::endl;
+}
+
+void PipelineCache::destroy()
+{
+	if (m_pipelineCache != VK_NULL_HANDLE)
+	{
+		vkDestroyPipelineCache(m_device, m_pipelineCache, nullptr);
+		m_pipelineCache = VK_NULL_HANDLE;
+	}
+}
+
+bool PipelineCache::readFile(std::vector<char>& data)
+{
+	std::ifstream file(m_path, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	size_t fileSize = (size_t)file.tellg();
+	data.resize(fileSize);
+
+	file.seekg(0);
+	file.read(data.data(), fileSize);
+
+	return file.good();
+}
+
+bool PipelineCache::validate(const std::vector<char>& file, std::string& reason) const
+{
+	if (file.size() < sizeof(FileHeader))
+	{
+		reason = "file truncated";
+		return false;
+	}
+
+	FileHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+
+	if (header.magic != s_magic || header.version != s_version)
+	{
+		reason = "unknown file format";
+		return false;
+	}
+
+	if (header.vendorID != m_deviceProperties.vendorID || header.deviceID != m_deviceProperties.deviceID ||
+		header.driverVersion != m_deviceProperties.driverVersion ||
+		memcmp(header.pipelineCacheUUID, m_deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		reason = "device or driver changed";
+		return false;
+	}
+
+	const char* data = file.data() + sizeof(FileHeader);
+	size_t dataSize = file.size() - sizeof(FileHeader);
+
+	if (header.dataSize != dataSize || header.checksum != checksum(data, dataSize))
+	{
+		reason = "payload corrupt";
+		return false;
+	}
+
+	//The payload should start with the driver's own header, check it agrees with our view of the device
+	VkPipelineCacheHeaderVersionOne vkHeader;
+	if (dataSize < sizeof(vkHeader))
+	{
+		reason = "payload truncated";
+		return false;
+	}
+	memcpy(&vkHeader, data, sizeof(vkHeader));
+
+	if (vkHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+		vkHeader.vendorID != m_deviceProperties.vendorID || vkHeader.deviceID != m_deviceProperties.deviceID ||
+		memcmp(vkHeader.pipelineCacheUUID, m_deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		reason = "payload header mismatch";
+		return false;
+	}
+
+	return true;
+}
+
+//FNV-1a, only used to catch truncated or corrupted files
+uint64_t PipelineCache::checksum(const char* data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= static_cast<uint8_t>(data[i]);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
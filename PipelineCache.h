@@ -0,0 +1,52 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+//Owns the VkPipelineCache shared by every pipeline the wrapper creates and persists it to disk between runs.
+//The file is a small header (magic, format version, device identity, payload size and checksum) followed by
+//the blob returned by vkGetPipelineCacheData. Anything that does not match the current device is discarded.
+class PipelineCache
+{
+public:
+	PipelineCache();
+	~PipelineCache();
+
+	void load(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path);
+	void save();
+	void destroy();
+
+	VkPipelineCache getHandle() const { return m_pipelineCache; }
+	bool isWarm() const { return m_loadedBytes > 0; }
+	double getLoadTimeMs() const { return m_loadTimeMs; }
+	double getSaveTimeMs() const { return m_saveTimeMs; }
+
+private:
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		uint64_t dataSize;
+		uint64_t checksum;
+	};
+
+	static const uint32_t s_magic = 0x43504B56; // "VKPC"
+	static const uint32_t s_version = 1;
+
+	bool readFile(std::vector<char>& data);
+	bool validate(const std::vector<char>& file, std::string& reason) const;
+	static uint64_t checksum(const char* data, size_t size);
+
+	VkDevice m_device;
+	VkPhysicalDeviceProperties m_deviceProperties;
+	VkPipelineCache m_pipelineCache;
+	std::string m_path;
+
+	size_t m_loadedBytes;
+	double m_loadTimeMs;
+	double m_saveTimeMs;
+};
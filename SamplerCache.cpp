@@ -0,0 +1,96 @@
+#include "SamplerCache.h"
+
+#include <cstring>
+#include <stdexcept>
+
+static uint32_t floatKey(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+SamplerCache::SamplerCache()
+	: m_device(VK_NULL_HANDLE)
+{
+}
+
+SamplerCache::~SamplerCache()
+{
+}
+
+void SamplerCache::init(VkDevice device)
+{
+	m_device = device;
+}
+
+void SamplerCache::destroy()
+{
+	for (const auto& sampler : m_samplers)
+	{
+		vkDestroySampler(m_device, sampler.second, nullptr);
+	}
+	m_samplers.clear();
+}
+
+VkSampler SamplerCache::getSampler(const VkSamplerCreateInfo& samplerInfo)
+{
+	if (samplerInfo.pNext != nullptr)
+	{
+		throw std::runtime_error("sampler cache cannot key a chained sampler create info!");
+	}
+
+	std::vector<uint32_t> key = {
+		samplerInfo.flags,
+		static_cast<uint32_t>(samplerInfo.magFilter),
+		static_cast<uint32_t>(samplerInfo.minFilter),
+		static_cast<uint32_t>(samplerInfo.mipmapMode),
+		static_cast<uint32_t>(samplerInfo.addressModeU),
+		static_cast<uint32_t>(samplerInfo.addressModeV),
+		static_cast<uint32_t>(samplerInfo.addressModeW),
+		floatKey(samplerInfo.mipLodBias),
+		samplerInfo.anisotropyEnable,
+		floatKey(samplerInfo.anisotropyEnable ? samplerInfo.maxAnisotropy : 0.0f),
+		samplerInfo.compareEnable,
+		static_cast<uint32_t>(samplerInfo.compareEnable ? samplerInfo.compareOp : VK_COMPARE_OP_NEVER),
+		floatKey(samplerInfo.minLod),
+		floatKey(samplerInfo.maxLod),
+		static_cast<uint32_t>(samplerInfo.borderColor),
+		samplerInfo.unnormalizedCoordinates,
+	};
+
+	auto found = m_samplers.find(key);
+	if (found != m_samplers.end())
+	{
+		return found->second;
+	}
+
+	VkSampler sampler;
+	if (vkCreateSampler(m_device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create texture sampler!");
+	}
+	m_samplers.emplace(std::move(key), sampler);
+	return sampler;
+}
+
+VkSamplerCreateInfo SamplerCache::linearRepeat(float maxAnisotropy)
+{
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.anisotropyEnable = maxAnisotropy > 1.0f ? VK_TRUE : VK_FALSE;
+	samplerInfo.maxAnisotropy = maxAnisotropy > 1.0f ? maxAnisotropy : 1.0f;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	return samplerInfo;
+}
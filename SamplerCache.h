@@ -0,0 +1,27 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <map>
+#include <vector>
+
+//Returns one VkSampler per distinct sampler description, so textures sharing filtering and addressing share a sampler
+//and the device's sampler limit is never a concern. Samplers live until destroy(). Extension structs chained through
+//pNext are not part of the key and are rejected.
+class SamplerCache
+{
+public:
+	SamplerCache();
+	~SamplerCache();
+
+	void init(VkDevice device);
+	void destroy();
+
+	VkSampler getSampler(const VkSamplerCreateInfo& samplerInfo);
+	size_t getSamplerCount() const { return m_samplers.size(); }
+
+	//Trilinear filtering over every mip level, anisotropic when maxAnisotropy is above 1
+	static VkSamplerCreateInfo linearRepeat(float maxAnisotropy);
+
+private:
+	VkDevice m_device;
+	std::map<std::vector<uint32_t>, VkSampler> m_samplers;
+};
@@ -0,0 +1,145 @@
+#include "ShaderLibrary.h"
+
+#include <fstream>
+#include <stdexcept>
+
+static const uint32_t s_spirvMagic = 0x07230203;
+static const size_t s_spirvHeaderWords = 5;
+
+ShaderLibrary::ShaderLibrary()
+{
+}
+
+ShaderLibrary::~ShaderLibrary()
+{
+	clear();
+}
+
+void ShaderLibrary::prefetch(const std::vector<std::string>& paths, StartupTimeline* timeline)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (const std::string& path : paths)
+	{
+		if (m_shaders.find(path) == m_shaders.end())
+		{
+			m_shaders[path] = std::async(std::launch::async, [path, timeline]() {
+				StartupTimeline::Clock::time_point start = StartupTimeline::Clock::now();
+				std::vector<uint32_t> code = load(path);
+				if (timeline)
+				{
+					timeline->record("load " + path, start, StartupTimeline::Clock::now());
+				}
+				return code;
+			}).share();
+		}
+	}
+}
+
+const std::vector<uint32_t>& ShaderLibrary::get(const std::string& path)
+{
+	std::shared_future<std::vector<uint32_t>> shader;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_shaders.find(path);
+		if (it == m_shaders.end())
+		{
+			//Not prefetched, load it on the calling thread
+			std::promise<std::vector<uint32_t>> promise;
+			it = m_shaders.emplace(path, promise.get_future().share()).first;
+			try
+			{
+				promise.set_value(load(path));
+			}
+			catch (...)
+			{
+				promise.set_exception(std::current_exception());
+			}
+		}
+		shader = it->second;
+	}
+
+	//The shared state outlives this local copy because the map still holds it
+	return shader.get();
+}
+
+VkShaderModule ShaderLibrary::createModule(VkDevice device, const std::string& path)
+{
+	const std::vector<uint32_t>& code = get(path);
+
+	VkShaderModuleCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = code.size() * sizeof(uint32_t);
+	createInfo.pCode = code.data();
+
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shader module!");
+	}
+
+	return shaderModule;
+}
+
+//Waits for any load still running so no worker outlives the library
+void ShaderLibrary::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto& shader : m_shaders)
+	{
+		shader.second.wait();
+	}
+	m_shaders.clear();
+}
+
+std::vector<uint32_t> ShaderLibrary::load(const std::string& path)
+{
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open())
+	{
+		throw std::runtime_error("failed to open shader file " + path + "!");
+	}
+
+	size_t fileSize = (size_t)file.tellg();
+	if (fileSize % sizeof(uint32_t) != 0)
+	{
+		throw std::runtime_error("invalid SPIR-V in " + path + ": size is not a multiple of 4!");
+	}
+
+	std::vector<uint32_t> code(fileSize / sizeof(uint32_t));
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(code.data()), fileSize);
+	if (!file)
+	{
+		throw std::runtime_error("failed to read shader file " + path + "!");
+	}
+
+	validate(code, path);
+	return code;
+}
+
+//Header checks only: magic number, version and id bound. Full validation is left to the validation layers
+void ShaderLibrary::validate(const std::vector<uint32_t>& code, const std::string& path)
+{
+	if (code.size() < s_spirvHeaderWords)
+	{
+		throw std::runtime_error("invalid SPIR-V in " + path + ": file is shorter than the header!");
+	}
+
+	if (code[0] != s_spirvMagic)
+	{
+		throw std::runtime_error("invalid SPIR-V in " + path + ": bad magic number (wrong endianness or not compiled?)!");
+	}
+
+	//Version word is 0x00MMmm00
+	uint32_t major = (code[1] >> 16) & 0xFF;
+	if (major != 1 || (code[1] & 0xFF0000FF) != 0)
+	{
+		throw std::runtime_error("invalid SPIR-V in " + path + ": unsupported version!");
+	}
+
+	if (code[3] == 0)
+	{
+		throw std::runtime_error("invalid SPIR-V in " + path + ": id bound is zero!");
+	}
+}
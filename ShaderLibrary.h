@@ -0,0 +1,36 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "StartupTimeline.h"
+
+//Loads SPIR-V binaries off the main thread. prefetch() starts reading and validating files on worker threads,
+//get() blocks only if that particular file has not finished yet. Binaries stay cached for the lifetime of the
+//library, so rebuilding a pipeline (e.g. after a swapchain format change) never touches the disk again.
+class ShaderLibrary
+{
+public:
+	ShaderLibrary();
+	~ShaderLibrary();
+
+	//Each load is recorded on the timeline when one is given
+	void prefetch(const std::vector<std::string>& paths, StartupTimeline* timeline = nullptr);
+
+	//Throws if the file is missing or is not a valid SPIR-V module
+	const std::vector<uint32_t>& get(const std::string& path);
+
+	VkShaderModule createModule(VkDevice device, const std::string& path);
+
+	void clear();
+
+	static std::vector<uint32_t> load(const std::string& path);
+
+private:
+	static void validate(const std::vector<uint32_t>& code, const std::string& path);
+
+	std::mutex m_mutex;
+	std::map<std::string, std::shared_future<std::vector<uint32_t>>> m_shaders;
+};
@@ -0,0 +1,63 @@
+#include "StartupTimeline.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+void StartupTimeline::start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_origin = Clock::now();
+	m_spans.clear();
+	m_threads.clear();
+
+	//The thread that starts the timeline is always listed as thread 0
+	m_threads[std::this_thread::get_id()] = 0;
+}
+
+void StartupTimeline::record(const std::string& name, Clock::time_point start, Clock::time_point end)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto thread = m_threads.find(std::this_thread::get_id());
+	if (thread == m_threads.end())
+	{
+		thread = m_threads.emplace(std::this_thread::get_id(), static_cast<uint32_t>(m_threads.size())).first;
+	}
+
+	Span span;
+	span.name = name;
+	span.startMs = std::chrono::duration<double, std::milli>(start - m_origin).count();
+	span.endMs = std::chrono::duration<double, std::milli>(end - m_origin).count();
+	span.thread = thread->second;
+	m_spans.push_back(span);
+}
+
+double StartupTimeline::elapsedMs() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return std::chrono::duration<double, std::milli>(Clock::now() - m_origin).count();
+}
+
+std::vector<StartupTimeline::Span> StartupTimeline::getSpans() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::vector<Span> spans = m_spans;
+	std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) { return a.startMs < b.startMs; });
+	return spans;
+}
+
+void StartupTimeline::print() const
+{
+	std::vector<Span> spans = getSpans();
+
+	std::cout << "Startup timeline (ms):" << std::endl;
+	std::ios::fmtflags flags = std::cout.flags();
+	std::cout << std::fixed << std::setprecision(2);
+	for (const Span& span : spans)
+	{
+		std::cout << "  " << std::setw(9) << span.startMs << " - " << std::setw(9) << span.endMs
+			<< "  [" << span.thread << "] " << span.name << " (" << span.endMs - span.startMs << ")" << std::endl;
+	}
+	std::cout.flags(flags);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Records named spans of startup work relative to a common origin, from any thread, and prints them in start order
+//with the thread each ran on. Used to see what overlaps during init() and where time-to-first-frame goes.
+class StartupTimeline
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Span
+	{
+		std::string name;
+		double startMs;
+		double endMs;
+		uint32_t thread;
+	};
+
+	void start();
+
+	void record(const std::string& name, Clock::time_point start, Clock::time_point end);
+
+	template<typename F>
+	void measure(const std::string& name, F&& function)
+	{
+		Clock::time_point start = Clock::now();
+		function();
+		record(name, start, Clock::now());
+	}
+
+	double elapsedMs() const;
+	std::vector<Span> getSpans() const;
+	void print() const;
+
+private:
+	Clock::time_point m_origin;
+	std::vector<Span> m_spans;
+	std::map<std::thread::id, uint32_t> m_threads;
+	mutable std::mutex m_mutex;
+};
@@ -0,0 +1,286 @@
+#include "TextureManager.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+//Colour textures are authored in sRGB, sampling converts them to linear
+static const VkFormat s_textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+static const uint32_t s_texelSize = 4;
+
+TextureManager::TextureManager()
+	: m_device(VK_NULL_HANDLE)
+	, m_physicalDevice(VK_NULL_HANDLE)
+	, m_allocator(nullptr)
+	, m_uploadManager(nullptr)
+	, m_maxAnisotropy(1.0f)
+	, m_canBlit(false)
+	, m_bytesUploaded(0)
+	, m_stagingMs(0.0)
+	, m_uploadMs(0.0)
+	, m_decodeMs(0.0)
+	, m_timedTicket(0)
+{
+}
+
+TextureManager::~TextureManager()
+{
+}
+
+void TextureManager::prefetch(const std::vector<std::string>& paths, StartupTimeline* timeline)
+{
+	for (const std::string& path : paths)
+	{
+		if (m_decodes.find(path) == m_decodes.end())
+		{
+			m_decodes[path] = std::async(std::launch::async, [path, timeline]() {
+				StartupTimeline::Clock::time_point start = StartupTimeline::Clock::now();
+				DecodedImage image = decode(path);
+				if (timeline)
+				{
+					timeline->record("decode " + path, start, StartupTimeline::Clock::now());
+				}
+				return image;
+			}).share();
+		}
+	}
+}
+
+void TextureManager::init(VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator& allocator, UploadManager& uploadManager,
+	const std::vector<uint32_t>& queueFamilies, float maxAnisotropy)
+{
+	m_device = device;
+	m_physicalDevice = physicalDevice;
+	m_allocator = &allocator;
+	m_uploadManager = &uploadManager;
+	m_queueFamilies = queueFamilies;
+	m_maxAnisotropy = maxAnisotropy;
+	m_samplers.init(m_device);
+
+	//Mips are blitted with linear filtering, without support textures keep just their top level
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(m_physicalDevice, s_textureFormat, &properties);
+	const VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	m_canBlit = (properties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+}
+
+void TextureManager::destroy()
+{
+	for (Texture& texture : m_textures)
+	{
+		vkDestroyImageView(m_device, texture.view, nullptr);
+		vkDestroyImage(m_device, texture.image, nullptr);
+		m_allocator->free(texture.memory);
+	}
+	m_textures.clear();
+	m_pending.clear();
+	m_samplers.destroy();
+	m_decodes.clear();
+}
+
+std::vector<uint32_t> TextureManager::load(const std::vector<std::string>& paths)
+{
+	//Anything not prefetched starts decoding now, all of it in parallel
+	prefetch(paths);
+
+	std::vector<uint32_t> indices;
+	for (const std::string& path : paths)
+	{
+		auto decoded = m_decodes.find(path);
+		DecodedImage image = decoded->second.get();
+		m_decodes.erase(decoded);
+
+		m_decodeMs += image.decodeMs;
+		indices.push_back(create(image.width, image.height, image.pixels.get(), true));
+	}
+	return indices;
+}
+
+uint32_t TextureManager::create(uint32_t width, uint32_t height, const void* rgba, bool generateMips)
+{
+	Texture texture;
+	texture.width = width;
+	texture.height = height;
+	if (generateMips && m_canBlit)
+	{
+		texture.mipLevels = static_cast<uint32_t>(std::floor(std::log2((std::max)(width, height)))) + 1;
+	}
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = width;
+	imageInfo.extent.height = height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = texture.mipLevels;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = s_textureFormat;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	//Written on the upload queue and blitted and sampled on graphics, shared rather than moved with ownership barriers
+	if (m_queueFamilies.size() > 1)
+	{
+		imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(m_queueFamilies.size());
+		imageInfo.pQueueFamilyIndices = m_queueFamilies.data();
+	}
+
+	if (vkCreateImage(m_device, &imageInfo, nullptr, &texture.image) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create texture image!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(m_device, texture.image, &memRequirements);
+	texture.memory = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+	vkBindImageMemory(m_device, texture.image, texture.memory.memory, texture.memory.offset);
+
+	auto stagingStart = std::chrono::steady_clock::now();
+	m_uploadManager->uploadImage(texture.image, width, height, texture.mipLevels, s_texelSize, rgba);
+	m_stagingMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stagingStart).count();
+	m_bytesUploaded += static_cast<VkDeviceSize>(width) * height * s_texelSize;
+
+	//The batch being recorded is submitted with the next ticket
+	texture.uploadTicket = m_uploadManager->getLastTicket() + 1;
+	m_timedTicket = texture.uploadTicket;
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = texture.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = s_textureFormat;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = texture.mipLevels;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	if (vkCreateImageView(m_device, &viewInfo, nullptr, &texture.view) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create texture image view!");
+	}
+
+	texture.sampler = m_samplers.getSampler(SamplerCache::linearRepeat(m_maxAnisotropy));
+
+	m_textures.push_back(texture);
+	m_pending.push_back(static_cast<uint32_t>(m_textures.size() - 1));
+	return m_pending.back();
+}
+
+void TextureManager::recordPendingWork(VkCommandBuffer commandBuffer)
+{
+	uint64_t submitted = m_uploadManager->getLastTicket();
+	std::vector<uint32_t> waiting;
+
+	for (uint32_t index : m_pending)
+	{
+		const Texture& texture = m_textures[index];
+		if (texture.uploadTicket > submitted)
+		{
+			waiting.push_back(index);
+			continue;
+		}
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.image = texture.image;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.subresourceRange.levelCount = 1;
+
+		//Each level is read back once it has been written, then handed to the fragment shader
+		int32_t mipWidth = static_cast<int32_t>(texture.width);
+		int32_t mipHeight = static_cast<int32_t>(texture.height);
+		for (uint32_t level = 1; level < texture.mipLevels; level++)
+		{
+			barrier.subresourceRange.baseMipLevel = level - 1;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+			int32_t nextWidth = (std::max)(mipWidth / 2, 1);
+			int32_t nextHeight = (std::max)(mipHeight / 2, 1);
+
+			VkImageBlit blit{};
+			blit.srcOffsets[0] = { 0, 0, 0 };
+			blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+			blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.srcSubresource.mipLevel = level - 1;
+			blit.srcSubresource.baseArrayLayer = 0;
+			blit.srcSubresource.layerCount = 1;
+			blit.dstOffsets[0] = { 0, 0, 0 };
+			blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+			blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.dstSubresource.mipLevel = level;
+			blit.dstSubresource.baseArrayLayer = 0;
+			blit.dstSubresource.layerCount = 1;
+			vkCmdBlitImage(commandBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+			mipWidth = nextWidth;
+			mipHeight = nextHeight;
+		}
+
+		//The last level was only ever written
+		barrier.subresourceRange.baseMipLevel = texture.mipLevels - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	m_pending.swap(waiting);
+}
+
+void TextureManager::startUploadTimer()
+{
+	m_timedSubmit = std::chrono::steady_clock::now();
+}
+
+void TextureManager::update()
+{
+	if (m_timedTicket != 0 && m_uploadManager->isComplete(m_timedTicket))
+	{
+		m_uploadMs = m_stagingMs + std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_timedSubmit).count();
+		m_timedTicket = 0;
+	}
+}
+
+TextureManager::DecodedImage TextureManager::decode(const std::string& path)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels)
+	{
+		throw std::runtime_error("failed to load texture image " + path + " (" + stbi_failure_reason() + ")!");
+	}
+
+	DecodedImage image;
+	image.pixels = std::shared_ptr<unsigned char>(pixels, stbi_image_free);
+	image.width = static_cast<uint32_t>(width);
+	image.height = static_cast<uint32_t>(height);
+	image.decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return image;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <chrono>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
+#include "SamplerCache.h"
+#include "StartupTimeline.h"
+
+//Loads RGBA8 textures with full mip chains. Files are decoded with stb_image on worker threads (prefetch() can start
+//before the device exists), level 0 of every texture goes through the UploadManager's staging ring into the current
+//batch, and the remaining levels are generated on the GPU with vkCmdBlitImage. Blits need a graphics queue, so
+//recordPendingWork() records them into the next frame's command buffer ahead of the render pass. That frame already
+//waits for the upload batch, and leaves every level in SHADER_READ_ONLY_OPTIMAL before any draw samples it.
+class TextureManager
+{
+public:
+	struct Texture
+	{
+		VkImage image = VK_NULL_HANDLE;
+		MemoryAllocation memory;
+		VkImageView view = VK_NULL_HANDLE;
+		VkSampler sampler = VK_NULL_HANDLE;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t mipLevels = 1;
+		//Upload batch that copies level 0, mips are only generated once a frame is sure to wait for it
+		uint64_t uploadTicket = 0;
+	};
+
+	TextureManager();
+	~TextureManager();
+
+	//Starts decoding on worker threads, load() picks the results up. Each decode is recorded on the timeline when one is given
+	void prefetch(const std::vector<std::string>& paths, StartupTimeline* timeline = nullptr);
+
+	//queueFamilies lists every family that touches the images, more than one makes them concurrently shared.
+	//maxAnisotropy of 1 or less disables anisotropic filtering
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator& allocator, UploadManager& uploadManager,
+		const std::vector<uint32_t>& queueFamilies, float maxAnisotropy);
+	void destroy();
+
+	//Returns each texture's index in the order given. Throws if a file cannot be decoded
+	std::vector<uint32_t> load(const std::vector<std::string>& paths);
+	uint32_t create(uint32_t width, uint32_t height, const void* rgba, bool generateMips);
+
+	//Graphics queue only: generates mips for, and transitions, every texture whose upload batch has been submitted
+	void recordPendingWork(VkCommandBuffer commandBuffer);
+
+	//Starts the clock on the batch holding the textures created so far, call right after flushing it. Only the time
+	//from here to completion counts towards getUploadMs(), so the batch should hold nothing but textures
+	void startUploadTimer();
+	//Call once a frame after UploadManager::collect(). Stops the clock the first time the timed batch is seen complete,
+	//without waiting for it, so the GPU time measured can run up to a frame long
+	void update();
+
+	const Texture& getTexture(uint32_t index) const { return m_textures[index]; }
+	size_t getTextureCount() const { return m_textures.size(); }
+	size_t getSamplerCount() const { return m_samplers.getSamplerCount(); }
+
+	//Level 0 bytes staged, time spent writing them into the staging ring plus the timed batch's time on the GPU (0 until
+	//update() has seen it complete), and decode time summed over the worker threads
+	VkDeviceSize getBytesUploaded() const { return m_bytesUploaded; }
+	double getUploadMs() const { return m_uploadMs; }
+	double getDecodeMs() const { return m_decodeMs; }
+
+private:
+	struct DecodedImage
+	{
+		std::shared_ptr<unsigned char> pixels;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		double decodeMs = 0.0;
+	};
+
+	static DecodedImage decode(const std::string& path);
+
+	VkDevice m_device;
+	VkPhysicalDevice m_physicalDevice;
+	MemoryAllocator* m_allocator;
+	UploadManager* m_uploadManager;
+	std::vector<uint32_t> m_queueFamilies;
+	float m_maxAnisotropy;
+	bool m_canBlit;
+
+	SamplerCache m_samplers;
+	std::vector<Texture> m_textures;
+	std::vector<uint32_t> m_pending;
+	std::map<std::string, std::shared_future<DecodedImage>> m_decodes;
+
+	VkDeviceSize m_bytesUploaded;
+	double m_stagingMs;
+	double m_uploadMs;
+	double m_decodeMs;
+	uint64_t m_timedTicket;
+	std::chrono::steady_clock::time_point m_timedSubmit;
+};
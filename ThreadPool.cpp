@@ -0,0 +1,112 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool()
+	: m_stopping(false)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+	stop();
+}
+
+void ThreadPool::start(uint32_t threadCount)
+{
+	stop();
+
+	m_stopping = false;
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		m_threads.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+void ThreadPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_jobAvailable.notify_all();
+
+	for (std::thread& thread : m_threads)
+	{
+		thread.join();
+	}
+	m_threads.clear();
+	m_jobs.clear();
+}
+
+void ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t)>& job)
+{
+	//Without workers everything runs on the calling thread
+	if (m_threads.empty())
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			job(i);
+		}
+		return;
+	}
+
+	std::mutex doneMutex;
+	std::condition_variable doneCondition;
+	uint32_t remaining = count;
+	std::exception_ptr error;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			m_jobs.push_back([&, i]() {
+				std::exception_ptr jobError;
+				try
+				{
+					job(i);
+				}
+				catch (...)
+				{
+					jobError = std::current_exception();
+				}
+
+				std::lock_guard<std::mutex> doneLock(doneMutex);
+				if (jobError && !error)
+				{
+					error = jobError;
+				}
+				if (--remaining == 0)
+				{
+					doneCondition.notify_one();
+				}
+			});
+		}
+	}
+	m_jobAvailable.notify_all();
+
+	std::unique_lock<std::mutex> doneLock(doneMutex);
+	doneCondition.wait(doneLock, [&remaining]() { return remaining == 0; });
+
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
+
+void ThreadPool::workerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobAvailable.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+			if (m_stopping && m_jobs.empty())
+			{
+				return;
+			}
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+		job();
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Fixed set of worker threads fed from a single job queue. parallelFor() is the only entry point the renderer
+//needs: it hands out indices 0..count-1 and blocks until every one has run, so a job index can safely own
+//per-index resources such as a command pool for the duration of the call.
+class ThreadPool
+{
+public:
+	ThreadPool();
+	~ThreadPool();
+
+	void start(uint32_t threadCount);
+	void stop();
+
+	uint32_t getThreadCount() const { return static_cast<uint32_t>(m_threads.size()); }
+
+	//Rethrows the first exception any job threw, after all jobs have finished
+	void parallelFor(uint32_t count, const std::function<void(uint32_t)>& job);
+
+private:
+	void workerLoop();
+
+	std::vector<std::thread> m_threads;
+	std::deque<std::function<void()>> m_jobs;
+	std::mutex m_mutex;
+	std::condition_variable m_jobAvailable;
+	bool m_stopping;
+};
@@ -0,0 +1,136 @@
+#include "TimelineSemaphore.h"
+
+#include <stdexcept>
+
+TimelineSemaphore::TimelineSemaphore()
+	: m_device(VK_NULL_HANDLE)
+	, m_semaphore(VK_NULL_HANDLE)
+	, m_lastSubmitted(0)
+	, m_completed(0)
+{
+}
+
+TimelineSemaphore::~TimelineSemaphore()
+{
+}
+
+void TimelineSemaphore::init(VkDevice device, uint64_t initialValue)
+{
+	m_device = device;
+	m_lastSubmitted = initialValue;
+	m_completed = initialValue;
+
+	VkSemaphoreTypeCreateInfo typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = initialValue;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+
+	if (vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_semaphore) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create timeline semaphore!");
+	}
+}
+
+void TimelineSemaphore::destroy()
+{
+	if (m_semaphore != VK_NULL_HANDLE)
+	{
+		vkDestroySemaphore(m_device, m_semaphore, nullptr);
+		m_semaphore = VK_NULL_HANDLE;
+	}
+	m_device = VK_NULL_HANDLE;
+}
+
+uint64_t TimelineSemaphore::getCompletedValue()
+{
+	if (m_completed < m_lastSubmitted)
+	{
+		uint64_t value = 0;
+		if (vkGetSemaphoreCounterValue(m_device, m_semaphore, &value) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to query timeline semaphore!");
+		}
+		m_completed = value;
+	}
+	return m_completed;
+}
+
+bool TimelineSemaphore::isComplete(uint64_t value)
+{
+	return value <= m_completed || value <= getCompletedValue();
+}
+
+bool TimelineSemaphore::wait(uint64_t value, uint64_t timeout)
+{
+	if (isComplete(value))
+	{
+		return true;
+	}
+
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &m_semaphore;
+	waitInfo.pValues = &value;
+
+	VkResult result = vkWaitSemaphores(m_device, &waitInfo, timeout);
+	if (result == VK_TIMEOUT)
+	{
+		return false;
+	}
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to wait for timeline semaphore!");
+	}
+
+	if (value > m_completed)
+	{
+		m_completed = value;
+	}
+	return true;
+}
+
+void SubmitSemaphores::wait(VkSemaphore semaphore, VkPipelineStageFlags stages, uint64_t value)
+{
+	if (m_waitCount == s_maxSemaphores)
+	{
+		throw std::runtime_error("too many wait semaphores for one submit!");
+	}
+
+	m_waitSemaphores[m_waitCount] = semaphore;
+	m_waitStages[m_waitCount] = stages;
+	m_waitValues[m_waitCount] = value;
+	m_waitCount++;
+}
+
+void SubmitSemaphores::signal(VkSemaphore semaphore, uint64_t value)
+{
+	if (m_signalCount == s_maxSemaphores)
+	{
+		throw std::runtime_error("too many signal semaphores for one submit!");
+	}
+
+	m_signalSemaphores[m_signalCount] = semaphore;
+	m_signalValues[m_signalCount] = value;
+	m_signalCount++;
+}
+
+void SubmitSemaphores::apply(VkSubmitInfo& submitInfo)
+{
+	m_timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	m_timelineInfo.waitSemaphoreValueCount = m_waitCount;
+	m_timelineInfo.pWaitSemaphoreValues = m_waitValues;
+	m_timelineInfo.signalSemaphoreValueCount = m_signalCount;
+	m_timelineInfo.pSignalSemaphoreValues = m_signalValues;
+
+	submitInfo.pNext = &m_timelineInfo;
+	submitInfo.waitSemaphoreCount = m_waitCount;
+	submitInfo.pWaitSemaphores = m_waitSemaphores;
+	submitInfo.pWaitDstStageMask = m_waitStages;
+	submitInfo.signalSemaphoreCount = m_signalCount;
+	submitInfo.pSignalSemaphores = m_signalSemaphores;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+
+//A timeline semaphore (core in Vulkan 1.2) plus the bookkeeping around it. Every submission that signals it reserves
+//the next value with advance(), so anything that submission used can be retired once getCompletedValue() has caught
+//up with that value. Progress is queried without blocking and the last completed value is cached, so checking
+//many resources against the same timeline costs at most one driver call.
+class TimelineSemaphore
+{
+public:
+	TimelineSemaphore();
+	~TimelineSemaphore();
+
+	void init(VkDevice device, uint64_t initialValue = 0);
+	void destroy();
+
+	VkSemaphore getHandle() const { return m_semaphore; }
+
+	//Reserves the value the next submission signals. Only call it for a submission that is actually made
+	uint64_t advance() { return ++m_lastSubmitted; }
+	uint64_t getLastSubmitted() const { return m_lastSubmitted; }
+
+	uint64_t getCompletedValue();
+	bool isComplete(uint64_t value);
+	//Returns false if the timeout expired first, timeout is in nanoseconds
+	bool wait(uint64_t value, uint64_t timeout = UINT64_MAX);
+
+private:
+	VkDevice m_device;
+	VkSemaphore m_semaphore;
+	uint64_t m_lastSubmitted;
+	uint64_t m_completed;
+};
+
+//Semaphores for one vkQueueSubmit. Binary semaphores such as the swapchain acquire/present pair take a value of 0,
+//which the driver ignores, so both kinds can be mixed in the same submission
+class SubmitSemaphores
+{
+public:
+	void wait(VkSemaphore semaphore, VkPipelineStageFlags stages, uint64_t value = 0);
+	void signal(VkSemaphore semaphore, uint64_t value = 0);
+
+	//Points submitInfo's semaphore arrays at this object, which has to outlive the vkQueueSubmit call
+	void apply(VkSubmitInfo& submitInfo);
+
+private:
+	static const uint32_t s_maxSemaphores = 4;
+
+	VkSemaphore m_waitSemaphores[s_maxSemaphores];
+	VkPipelineStageFlags m_waitStages[s_maxSemaphores];
+	uint64_t m_waitValues[s_maxSemaphores];
+	uint32_t m_waitCount = 0;
+
+	VkSemaphore m_signalSemaphores[s_maxSemaphores];
+	uint64_t m_signalValues[s_maxSemaphores];
+	uint32_t m_signalCount = 0;
+
+	VkTimelineSemaphoreSubmitInfo m_timelineInfo{};
+};
@@ -0,0 +1,356 @@
+#include "UploadManager.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+//Keeps every copy source suitably aligned for vkCmdCopyBuffer and for texel copies of common formats
+static const VkDeviceSize s_stagingAlignment = 16;
+
+UploadManager::UploadManager()
+	: m_device(VK_NULL_HANDLE)
+	, m_allocator(nullptr)
+	, m_queue(VK_NULL_HANDLE)
+	, m_queueFamilyIndex(0)
+	, m_commandPool(VK_NULL_HANDLE)
+	, m_stagingBuffer(VK_NULL_HANDLE)
+	, m_stagingSize(0)
+	, m_stagingHead(0)
+	, m_stagingInUse(0)
+	, m_currentBatch(0)
+	, m_recording(false)
+	, m_bytesUploaded(0)
+{
+}
+
+UploadManager::~UploadManager()
+{
+}
+
+void UploadManager::init(VkDevice device, MemoryAllocator& allocator, VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize stagingSize)
+{
+	m_device = device;
+	m_allocator = &allocator;
+	m_queue = queue;
+	m_queueFamilyIndex = queueFamilyIndex;
+	m_stagingSize = stagingSize;
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = m_queueFamilyIndex;
+
+	if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create upload command pool!");
+	}
+
+	VkCommandBuffer commandBuffers[s_batchCount];
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = m_commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = s_batchCount;
+
+	if (vkAllocateCommandBuffers(m_device, &allocInfo, commandBuffers) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate upload command buffers!");
+	}
+
+	for (uint32_t i = 0; i < s_batchCount; i++)
+	{
+		m_batches[i].commandBuffer = commandBuffers[i];
+	}
+
+	m_timeline.init(m_device);
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = m_stagingSize;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &m_stagingBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create staging ring buffer!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(m_device, m_stagingBuffer, &memRequirements);
+	m_stagingMemory = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true);
+	vkBindBufferMemory(m_device, m_stagingBuffer, m_stagingMemory.memory, m_stagingMemory.offset);
+}
+
+void UploadManager::destroy()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	if (m_timeline.getHandle() != VK_NULL_HANDLE)
+	{
+		m_timeline.wait(flush());
+	}
+	m_timeline.destroy();
+	for (uint32_t i = 0; i < s_batchCount; i++)
+	{
+		m_batches[i] = Batch{};
+	}
+	m_stagingInUse = 0;
+	m_stagingHead = 0;
+
+	vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+	vkDestroyBuffer(m_device, m_stagingBuffer, nullptr);
+	m_allocator->free(m_stagingMemory);
+
+	m_commandPool = VK_NULL_HANDLE;
+	m_stagingBuffer = VK_NULL_HANDLE;
+	m_device = VK_NULL_HANDLE;
+}
+
+void UploadManager::uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+{
+	//Anything larger than half the ring is streamed through it in pieces
+	const char* source = static_cast<const char*>(data);
+	VkDeviceSize maxChunk = m_stagingSize / 2;
+
+	while (size > 0)
+	{
+		VkDeviceSize chunk = (std::min)(size, maxChunk);
+		VkDeviceSize stagingOffset = allocateStaging(chunk);
+
+		memcpy(static_cast<char*>(m_stagingMemory.mappedData) + stagingOffset, source, (size_t)chunk);
+
+		VkBufferCopy region{};
+		region.srcOffset = stagingOffset;
+		region.dstOffset = dstOffset;
+		region.size = chunk;
+		vkCmdCopyBuffer(beginBatch().commandBuffer, m_stagingBuffer, dstBuffer, 1, &region);
+
+		m_bytesUploaded += chunk;
+		source += chunk;
+		dstOffset += chunk;
+		size -= chunk;
+	}
+}
+
+void UploadManager::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, const VkBufferCopy& region)
+{
+	vkCmdCopyBuffer(beginBatch().commandBuffer, srcBuffer, dstBuffer, 1, &region);
+}
+
+void UploadManager::uploadImage(VkImage dstImage, uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t texelSize, const void* data)
+{
+	VkDeviceSize rowBytes = static_cast<VkDeviceSize>(width) * texelSize;
+	VkDeviceSize maxChunk = m_stagingSize / 2;
+	if (rowBytes > maxChunk)
+	{
+		throw std::runtime_error("image row does not fit in the staging ring!");
+	}
+
+	//Copies recorded into a later batch still come after this in queue submission order
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = dstImage;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(beginBatch().commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	const char* source = static_cast<const char*>(data);
+	uint32_t rowsPerChunk = static_cast<uint32_t>(maxChunk / rowBytes);
+
+	for (uint32_t row = 0; row < height; )
+	{
+		uint32_t rows = (std::min)(rowsPerChunk, height - row);
+		VkDeviceSize chunk = rowBytes * rows;
+		VkDeviceSize stagingOffset = allocateStaging(chunk);
+
+		memcpy(static_cast<char*>(m_stagingMemory.mappedData) + stagingOffset, source, (size_t)chunk);
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = stagingOffset;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { 0, static_cast<int32_t>(row), 0 };
+		region.imageExtent = { width, rows, 1 };
+		vkCmdCopyBufferToImage(beginBatch().commandBuffer, m_stagingBuffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+		m_bytesUploaded += chunk;
+		source += chunk;
+		row += rows;
+	}
+}
+
+uint64_t UploadManager::flush()
+{
+	if (!m_recording)
+	{
+		return m_timeline.getLastSubmitted();
+	}
+
+	Batch& batch = m_batches[m_currentBatch];
+
+	if (vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to record upload command buffer!");
+	}
+
+	uint64_t ticket = m_timeline.advance();
+
+	SubmitSemaphores semaphores;
+	semaphores.signal(m_timeline.getHandle(), ticket);
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.commandBuffer;
+	semaphores.apply(submitInfo);
+
+	if (vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit upload batch!");
+	}
+
+	batch.ticket = ticket;
+	batch.inFlight = true;
+	m_recording = false;
+	m_currentBatch = (m_currentBatch + 1) % s_batchCount;
+
+	return batch.ticket;
+}
+
+void UploadManager::collect()
+{
+	uint64_t completed = m_timeline.getCompletedValue();
+	for (uint32_t i = 0; i < s_batchCount; i++)
+	{
+		Batch& batch = m_batches[i];
+		if (batch.inFlight && batch.ticket <= completed)
+		{
+			retire(batch);
+		}
+	}
+}
+
+bool UploadManager::isComplete(uint64_t ticket)
+{
+	if (!m_timeline.isComplete(ticket))
+	{
+		return false;
+	}
+
+	collect();
+	return true;
+}
+
+void UploadManager::wait(uint64_t ticket)
+{
+	if (ticket > m_timeline.getLastSubmitted())
+	{
+		flush();
+	}
+
+	m_timeline.wait(ticket);
+	collect();
+}
+
+UploadManager::Batch& UploadManager::beginBatch()
+{
+	Batch& batch = m_batches[m_currentBatch];
+	if (m_recording)
+	{
+		return batch;
+	}
+
+	//The slot is reused in submission order, so if it is still in flight it is the oldest batch
+	if (batch.inFlight)
+	{
+		m_timeline.wait(batch.ticket);
+		retire(batch);
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkResetCommandBuffer(batch.commandBuffer, 0);
+	if (vkBeginCommandBuffer(batch.commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to begin upload command buffer!");
+	}
+
+	batch.stagingBytes = 0;
+	m_recording = true;
+	return batch;
+}
+
+//Bump allocates from the ring. Space is charged to the batch being recorded (including any bytes skipped when
+//wrapping) and handed back when that batch retires; batches retire in order, so the ring never fragments.
+VkDeviceSize UploadManager::allocateStaging(VkDeviceSize size)
+{
+	VkDeviceSize offset = (m_stagingHead + s_stagingAlignment - 1) / s_stagingAlignment * s_stagingAlignment;
+	if (offset + size > m_stagingSize)
+	{
+		offset = 0;
+	}
+	VkDeviceSize consumed = (offset >= m_stagingHead ? offset - m_stagingHead : m_stagingSize - m_stagingHead) + size;
+
+	while (m_stagingInUse + consumed > m_stagingSize)
+	{
+		retireOldest();
+	}
+
+	Batch& batch = beginBatch();
+	batch.stagingBytes += consumed;
+	m_stagingInUse += consumed;
+	m_stagingHead = offset + size;
+
+	return offset;
+}
+
+void UploadManager::retire(Batch& batch)
+{
+	m_stagingInUse -= batch.stagingBytes;
+	batch.stagingBytes = 0;
+	batch.inFlight = false;
+}
+
+//Frees ring space by waiting for the oldest batch, submitting the one being recorded first if it is all that is left
+void UploadManager::retireOldest()
+{
+	Batch* oldest = nullptr;
+	for (uint32_t i = 0; i < s_batchCount; i++)
+	{
+		if (m_batches[i].inFlight && (!oldest || m_batches[i].ticket < oldest->ticket))
+		{
+			oldest = &m_batches[i];
+		}
+	}
+
+	if (!oldest)
+	{
+		if (!m_recording)
+		{
+			throw std::runtime_error("staging ring exhausted with nothing in flight!");
+		}
+		wait(flush());
+		return;
+	}
+
+	m_timeline.wait(oldest->ticket);
+	retire(*oldest);
+}
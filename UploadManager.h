@@ -0,0 +1,79 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include "MemoryAllocator.h"
+#include "TimelineSemaphore.h"
+
+//Batches buffer and image uploads into one command buffer per flush instead of one submit + vkQueueWaitIdle per copy.
+//Source data is written into a persistently mapped staging ring; each flush submits the recorded copies and returns
+//a ticket, which is the value the batch signals on the manager's timeline semaphore. Ring space and the batch's command
+//buffer are recycled once the timeline has reached that value, so the CPU only blocks when the ring or every batch
+//slot is genuinely still in use by the GPU. Other queues can wait on a ticket GPU side through getTimeline().
+//Runs on whatever queue it is given, normally a dedicated transfer queue when the device has one.
+class UploadManager
+{
+public:
+	UploadManager();
+	~UploadManager();
+
+	void init(VkDevice device, MemoryAllocator& allocator, VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize stagingSize = 16ull * 1024 * 1024);
+	void destroy();
+
+	//Copies data into the staging ring now and records the GPU copy into the current batch
+	void uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, const VkBufferCopy& region);
+	//Copies tightly packed texels into mip 0 of a 2D colour image, a band of rows at a time if it does not fit in half
+	//the ring. Every level is moved to TRANSFER_DST_OPTIMAL first and left there for whoever fills the other levels
+	void uploadImage(VkImage dstImage, uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t texelSize, const void* data);
+
+	//Submits everything recorded since the last flush. Returns the ticket of the newest submitted batch
+	uint64_t flush();
+
+	//Recycles batches the timeline has passed without blocking
+	void collect();
+	bool isComplete(uint64_t ticket);
+	void wait(uint64_t ticket);
+
+	bool hasPendingWork() const { return m_recording; }
+	uint32_t getQueueFamilyIndex() const { return m_queueFamilyIndex; }
+	VkDeviceSize getBytesUploaded() const { return m_bytesUploaded; }
+	uint64_t getBatchesSubmitted() const { return m_timeline.getLastSubmitted(); }
+	//Ticket of the newest submitted batch, 0 before the first flush
+	uint64_t getLastTicket() const { return m_timeline.getLastSubmitted(); }
+	VkSemaphore getTimeline() const { return m_timeline.getHandle(); }
+
+private:
+	struct Batch
+	{
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		uint64_t ticket = 0;
+		VkDeviceSize stagingBytes = 0;
+		bool inFlight = false;
+	};
+
+	static const uint32_t s_batchCount = 4;
+
+	Batch& beginBatch();
+	VkDeviceSize allocateStaging(VkDeviceSize size);
+	void retire(Batch& batch);
+	void retireOldest();
+
+	VkDevice m_device;
+	MemoryAllocator* m_allocator;
+	VkQueue m_queue;
+	uint32_t m_queueFamilyIndex;
+	VkCommandPool m_commandPool;
+
+	VkBuffer m_stagingBuffer;
+	MemoryAllocation m_stagingMemory;
+	VkDeviceSize m_stagingSize;
+	VkDeviceSize m_stagingHead;
+	VkDeviceSize m_stagingInUse;
+
+	Batch m_batches[s_batchCount];
+	uint32_t m_currentBatch;
+	bool m_recording;
+
+	TimelineSemaphore m_timeline;
+	VkDeviceSize m_bytesUploaded;
+};
@@ -0,0 +1,121 @@
+#include "vertex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+//Round to nearest even, overflow becomes infinity and values too small for a half subnormal become zero
+static uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t floatExponent = (bits >> 23) & 0xFF;
+	uint32_t mantissa = bits & 0x7FFFFF;
+	int32_t exponent = static_cast<int32_t>(floatExponent) - 127 + 15;
+
+	if (floatExponent == 0xFF)
+	{
+		return static_cast<uint16_t>(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));
+	}
+	if (exponent >= 31)
+	{
+		return static_cast<uint16_t>(sign | 0x7C00);
+	}
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+		{
+			return static_cast<uint16_t>(sign);
+		}
+		mantissa |= 0x800000;
+		uint32_t shift = static_cast<uint32_t>(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1)))
+		{
+			half++;
+		}
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	//A carry out of the mantissa moves into the exponent, which is still the correctly rounded result
+	uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1FFF;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+	{
+		half++;
+	}
+	return static_cast<uint16_t>(sign | half);
+}
+
+static uint8_t toUnorm8(float value)
+{
+	return static_cast<uint8_t>(std::lround((std::min)((std::max)(value, 0.0f), 1.0f) * 255.0f));
+}
+
+static int16_t toSnorm16(float value)
+{
+	return static_cast<int16_t>(std::lround((std::min)((std::max)(value, -1.0f), 1.0f) * 32767.0f));
+}
+
+Half4 packHalf4(const glm::vec4& value)
+{
+	return Half4{ floatToHalf(value.x), floatToHalf(value.y), floatToHalf(value.z), floatToHalf(value.w) };
+}
+
+Unorm8x4 packUnorm8x4(const glm::vec4& value)
+{
+	return Unorm8x4{ toUnorm8(value.x), toUnorm8(value.y), toUnorm8(value.z), toUnorm8(value.w) };
+}
+
+Snorm16x2 packSnorm16x2(const glm::vec2& value)
+{
+	return Snorm16x2{ toSnorm16(value.x), toSnorm16(value.y) };
+}
+
+//Projects onto the octahedron |x| + |y| + |z| = 1 and folds the lower half over the diagonals. A zero vector
+//encodes as +Z
+OctNormal packOctNormal(const glm::vec3& normal)
+{
+	float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+	if (length == 0.0f)
+	{
+		return OctNormal{ 0, 0 };
+	}
+
+	float x = normal.x / length;
+	float y = normal.y / length;
+	if (normal.z < 0.0f)
+	{
+		float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+	return OctNormal{ toSnorm16(x), toSnorm16(y) };
+}
+
+PackedVertex packVertex(const Vertex& vertex)
+{
+	PackedVertex packed;
+	packed.pos = packHalf4(glm::vec4(vertex.pos, 1.0f));
+	packed.color = packUnorm8x4(glm::vec4(vertex.color, 1.0f));
+	packed.texCoord = packSnorm16x2(vertex.texCoord);
+	packed.normal = packOctNormal(vertex.normal);
+	return packed;
+}
+
+//GLM matrices are column major, so row i is element i of each column
+InstanceData packInstance(const glm::mat4& model, const glm::vec4& color, uint32_t materialIndex)
+{
+	InstanceData instance;
+	instance.modelRow0 = glm::vec4(model[0][0], model[1][0], model[2][0], model[3][0]);
+	instance.modelRow1 = glm::vec4(model[0][1], model[1][1], model[2][1], model[3][1]);
+	instance.modelRow2 = glm::vec4(model[0][2], model[1][2], model[2][2], model[3][2]);
+	instance.color = packUnorm8x4(color);
+	instance.materialIndex = materialIndex;
+	return instance;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+//Packed attribute types. The vertex fetch expands each of them to floats, so shaders read them like full precision
+//attributes; only octahedral normals need decoding in the shader
+struct Half4
+{
+	uint16_t x, y, z, w;
+};
+
+struct Unorm8x4
+{
+	uint8_t x, y, z, w;
+};
+
+struct Snorm16x2
+{
+	int16_t x, y;
+};
+
+//A unit vector folded onto an octahedron and unfolded into the [-1, 1] square, see octDecode in shader.vert
+struct OctNormal
+{
+	int16_t x, y;
+};
+
+Half4 packHalf4(const glm::vec4& value);
+Unorm8x4 packUnorm8x4(const glm::vec4& value);
+//Values outside [-1, 1] are clamped
+Snorm16x2 packSnorm16x2(const glm::vec2& value);
+OctNormal packOctNormal(const glm::vec3& normal);
+
+//The Vulkan format each attribute type is fetched as
+template<typename T> struct VertexFormatOf;
+template<> struct VertexFormatOf<float> { static constexpr VkFormat value = VK_FORMAT_R32_SFLOAT; };
+template<> struct VertexFormatOf<uint32_t> { static constexpr VkFormat value = VK_FORMAT_R32_UINT; };
+template<> struct VertexFormatOf<glm::vec2> { static constexpr VkFormat value = VK_FORMAT_R32G32_SFLOAT; };
+template<> struct VertexFormatOf<glm::vec3> { static constexpr VkFormat value = VK_FORMAT_R32G32B32_SFLOAT; };
+template<> struct VertexFormatOf<glm::vec4> { static constexpr VkFormat value = VK_FORMAT_R32G32B32A32_SFLOAT; };
+template<> struct VertexFormatOf<Half4> { static constexpr VkFormat value = VK_FORMAT_R16G16B16A16_SFLOAT; };
+template<> struct VertexFormatOf<Unorm8x4> { static constexpr VkFormat value = VK_FORMAT_R8G8B8A8_UNORM; };
+template<> struct VertexFormatOf<Snorm16x2> { static constexpr VkFormat value = VK_FORMAT_R16G16_SNORM; };
+template<> struct VertexFormatOf<OctNormal> { static constexpr VkFormat value = VK_FORMAT_R16G16_SNORM; };
+
+struct VertexAttribute
+{
+	uint32_t offset;
+	uint32_t size;
+	VkFormat format;
+};
+
+//Offset, size and format of one member, all worked out by the compiler from the member's declaration
+#define VERTEX_ATTRIBUTE(Struct, member) VertexAttribute{ static_cast<uint32_t>(offsetof(Struct, member)), \
+	static_cast<uint32_t>(sizeof(Struct::member)), VertexFormatOf<decltype(Struct::member)>::value }
+
+//Specialised once per vertex struct with a constexpr std::array `value` of VERTEX_ATTRIBUTEs in shader location order
+template<typename Vertex> struct VertexAttributes;
+
+template<typename Vertex>
+constexpr size_t getAttributeBytes()
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < VertexAttributes<Vertex>::value.size(); i++)
+	{
+		bytes += VertexAttributes<Vertex>::value[i].size;
+	}
+	return bytes;
+}
+
+//Binding and attribute descriptions for a vertex struct, derived from its VertexAttributes. Fails to compile if the
+//attributes leave any byte of the struct uncovered, so a member cannot be added without being described
+template<typename Vertex>
+class VertexLayout
+{
+public:
+	static constexpr size_t attributeCount = VertexAttributes<Vertex>::value.size();
+
+	static VkVertexInputBindingDescription getBindingDescription(uint32_t binding = 0, VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX)
+	{
+		VkVertexInputBindingDescription bindingDescription{};
+		bindingDescription.binding = binding;
+		bindingDescription.stride = sizeof(Vertex);
+		bindingDescription.inputRate = inputRate;
+
+		return bindingDescription;
+	}
+
+	static std::array<VkVertexInputAttributeDescription, attributeCount> getAttributeDescriptions(uint32_t binding = 0, uint32_t firstLocation = 0)
+	{
+		std::array<VkVertexInputAttributeDescription, attributeCount> attributeDescriptions{};
+		for (uint32_t i = 0; i < attributeCount; i++)
+		{
+			attributeDescriptions[i].binding = binding;
+			attributeDescriptions[i].location = firstLocation + i;
+			attributeDescriptions[i].format = VertexAttributes<Vertex>::value[i].format;
+			attributeDescriptions[i].offset = VertexAttributes<Vertex>::value[i].offset;
+		}
+
+		return attributeDescriptions;
+	}
+
+	static_assert(getAttributeBytes<Vertex>() == sizeof(Vertex), "vertex attributes must cover every byte of the vertex struct");
+};
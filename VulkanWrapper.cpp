@@ -1,19 +1,32 @@
 #include "vulkanWrapper.h"
 #include "DebugCallBack.h"
+#include "MeshBaker.h"
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#ifdef _WIN32
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include <GLFW/glfw3native.h>
+#endif
 
 #define NOMINMAX
 #include <iostream>
 #include <cstring>
 #include <set>
+#include <map>
 #include <cstdint> // Necessary for uint32_t
 #include <limits> // Necessary for std::numeric_limits
 #include <algorithm> // Necessary for std::clamp
+#include <chrono>
+#include <future>
+#include <glm/gtc/matrix_transform.hpp>
+
+//Sizes of the bindless arrays, far below the update-after-bind limits of any device that supports them
+static const uint32_t s_maxBindlessTextures = 4096;
+static const uint32_t s_maxBindlessBuffers = 1024;
 
 static void framebufferResizeCallback(GLFWwindow* window, int width, int height) 
 {
@@ -22,55 +35,157 @@ static void framebufferResizeCallback(GLFWwindow* window, int width, int height)
 }
 
 VulkanWrapper::VulkanWrapper(uint32_t width, uint32_t height)
-	: m_window(nullptr)
+	: VulkanWrapper(Settings{ width, height })
+{
+}
+
+VulkanWrapper::VulkanWrapper(const Settings& settings)
+	: m_settings(settings)
+	, m_window(nullptr)
 	, m_windowHeight(800)
 	, m_windowWidth(600)
 	, m_vkInstance(VK_NULL_HANDLE)
 	, m_physicalDevice(VK_NULL_HANDLE)
+	, m_logicalDevice(VK_NULL_HANDLE)
+	, m_graphicsQueue(VK_NULL_HANDLE)
+	, m_presentQueue(VK_NULL_HANDLE)
+	, m_transferQueue(VK_NULL_HANDLE)
+	, m_computeQueue(VK_NULL_HANDLE)
+	, m_surface(VK_NULL_HANDLE)
+	, m_swapchain(VK_NULL_HANDLE)
+	, m_graphicsPipeline(VK_NULL_HANDLE)
+	, m_renderPass(VK_NULL_HANDLE)
+	, m_descriptorSetLayout(VK_NULL_HANDLE)
+	, m_pipelineLayout(VK_NULL_HANDLE)
+	, m_vertexBuffer(VK_NULL_HANDLE)
+	, m_indexBuffer(VK_NULL_HANDLE)
+	, m_materialBuffer(VK_NULL_HANDLE)
+	, m_materialSetLayout(VK_NULL_HANDLE)
 	, m_debugMessenger(VK_NULL_HANDLE)
+	, m_currentFrame(0)
+	, m_framesInFlight(std::clamp(settings.framesInFlight, 1u, m_maxFramesInFlight))
 {
-	m_windowWidth = width;
-	m_windowHeight = height;
-
-	initWindow();
-	initialiseVulkan();
-	mainloop();
-	cleanUp();
+	m_windowWidth = settings.width;
+	m_windowHeight = settings.height;
 }
 
 VulkanWrapper::~VulkanWrapper()
 {
-
+	shutdown();
 }
 
 void VulkanWrapper::initWindow()
 {
+	if (m_settings.headless)
+	{
+		return;
+	}
+
 	glfwInit();
+	m_glfwInitialised = true;
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 	m_window = glfwCreateWindow(m_windowWidth, m_windowHeight, "VulkanMain", nullptr,nullptr);
+	glfwSetWindowUserPointer(m_window, this);
 	glfwSetFramebufferSizeCallback(m_window, framebufferResizeCallback);
 }
 
+//Shader files are read on worker threads while the instance and device are created, and pipelines compile on
+//workers while the framebuffers, command pool and geometry are set up. Each step is recorded on m_timeline
 void VulkanWrapper::initialiseVulkan()
 {
-	createInstance();
-	setupDebugMessager();
-	createSurface();
-	selectPhysicalDevice();
-	createLogicalDevice();
-	createSurface();
-	createSwapChain();
-	createImageViews();
-	createRenderPass();
-	createGraphicsPipeline();
-	createFrameBuffers();
-	createCommandPool();
-	createVertexBuffers();
-	createIndexBuffer();
-	createCommandBuffers();
-	createSyncObjects();
+	//GPU-driven mode replaces the transform path before any shader or pipeline is picked for it. A device that falls
+	//back to recording on the CPU keeps the storage buffer path, so the run compares like with like
+	if (m_settings.gpuDriven && m_settings.transformPath != TransformPath::StorageBuffer)
+	{
+		std::cout << "GPU-driven mode reads transforms from a storage buffer, ignoring the requested transform path" << std::endl;
+		m_settings.transformPath = TransformPath::StorageBuffer;
+	}
+
+	//Whether bindless actually runs is only known once a device is picked, so asking for it prefetches both fragment shaders
+	std::vector<std::string> shaders = {
+		m_settings.transformPath == TransformPath::InstanceAttributes ? "shaders/vert_instanced.spv" : "shaders/vert.spv",
+		"shaders/frag.spv"
+	};
+	if (m_settings.bindless)
+	{
+		shaders.push_back("shaders/frag_bindless.spv");
+	}
+	if (m_settings.gpuDriven)
+	{
+		shaders.push_back("shaders/cull.spv");
+	}
+	m_shaders.prefetch(shaders, &m_timeline);
+	m_textures.prefetch(m_settings.texturePaths, &m_timeline);
+
+	m_timeline.measure("createInstance", [this] { createInstance(); });
+	m_timeline.measure("setupDebugMessenger", [this] { setupDebugMessager(); });
+	m_timeline.measure("createSurface", [this] { createSurface(); });
+	m_timeline.measure("selectPhysicalDevice", [this] { selectPhysicalDevice(); });
+	m_timeline.measure("createLogicalDevice", [this] { createLogicalDevice(); });
+	m_timeline.measure("createAllocator", [this] { createAllocator(); });
+	m_timeline.measure("createPipelineCache", [this] { createPipelineCache(); });
+	m_timeline.measure(m_settings.headless ? "createOffscreenTargets" : "createSwapChain", [this] {
+		if (m_settings.headless)
+		{
+			createOffscreenTargets();
+		}
+		else
+		{
+			createSwapChain();
+		}
+	});
+	m_timeline.measure("createImageViews", [this] { createImageViews(); });
+	m_timeline.measure("createRenderPass", [this] { createRenderPass(); });
+	m_timeline.measure("createDescriptorSetLayout", [this] {
+		createDescriptorCaches();
+		createDescriptorSetLayout();
+		createMaterialSetLayout();
+		createCullSetLayout();
+	});
+
+	//Independent pipelines each get their own job, get() below rethrows anything a job threw
+	std::vector<std::future<void>> pipelineJobs;
+	pipelineJobs.push_back(std::async(std::launch::async, [this] {
+		m_timeline.measure("createGraphicsPipeline", [this] { createGraphicsPipeline(); });
+	}));
+	if (m_gpuDriven)
+	{
+		pipelineJobs.push_back(std::async(std::launch::async, [this] {
+			m_timeline.measure("createCullPipeline", [this] { createCullPipeline(); });
+		}));
+	}
+
+	m_timeline.measure("createFrameBuffers", [this] { createFrameBuffers(); });
+	m_timeline.measure("createFrameContexts", [this] { createFrameContexts(); });
+	m_timeline.measure("createUploadManager", [this] { createUploadManager(); });
+	m_timeline.measure("createFrameProfiler", [this] { createFrameProfiler(); });
+	m_timeline.measure("loadMesh", [this] { loadMesh(); });
+	m_timeline.measure("uploadResources", [this] {
+		createVertexBuffers();
+		createIndexBuffer();
+		//Both streams are in the staging ring now
+		m_mesh.close();
+		createTexureImage();
+		createMaterials();
+		createGpuScene();
+
+		//Geometry, materials and the GPU scene are needed by the very first frame, whose submission waits for the last
+		//batch on the GPU. Batches on one queue complete in order, so that covers the geometry's too
+		m_uploadManager.flush();
+	});
+	m_timeline.measure("createRecordingThreads", [this] { createRecordingThreads(); });
+	m_timeline.measure("createSyncObjects", [this] { createSyncObjects(); });
+
+	m_timeline.measure("waitForPipelines", [&pipelineJobs] {
+		for (auto& job : pipelineJobs)
+		{
+			job.get();
+		}
+	});
+
+	m_allocator.printStats();
 }
 
 
@@ -84,27 +199,12 @@ void VulkanWrapper::createInstance()
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	appInfo.pEngineName = "No Engine";
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	appInfo.apiVersion = VK_API_VERSION_1_0;
+	appInfo.apiVersion = VK_API_VERSION_1_2;
 
 	VkInstanceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	createInfo.pApplicationInfo = &appInfo;
 
-	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions;
-
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-	createInfo.enabledExtensionCount = glfwExtensionCount;
-	createInfo.ppEnabledExtensionNames = glfwExtensions;
-	createInfo.enabledLayerCount = 0;
-
-	VkResult result = vkCreateInstance(&createInfo, nullptr, &m_vkInstance);
-
-	if (vkCreateInstance(&createInfo, nullptr, &m_vkInstance) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create instance!");
-	}
-
 	handleExtensions();
 
 	if (enableValidationLayers && !checkValidationLayerSupport()) 
@@ -188,26 +288,160 @@ bool VulkanWrapper::checkValidationLayerSupport()
 	return true;
 }
 
-void VulkanWrapper::mainloop()
+void VulkanWrapper::init()
+{
+	m_timeline.start();
+	m_timeline.measure("initWindow", [this] { initWindow(); });
+	initialiseVulkan();
+	m_runStats.startupMs = m_timeline.elapsedMs();
+	m_runStats.framesInFlight = m_framesInFlight;
+	m_runStats.imageCount = static_cast<uint32_t>(m_swapChainImages.size());
+	m_runStats.bindless = m_bindless;
+	m_runStats.gpuDriven = m_gpuDriven;
+	m_runStats.transformPath = m_settings.transformPath;
+	m_runStats.textures = static_cast<uint32_t>(m_textures.getTextureCount());
+
+	m_timeline.print();
+	std::cout << "Startup took " << m_runStats.startupMs << "ms" << std::endl;
+}
+
+void VulkanWrapper::run()
+{
+	while (tick())
+	{
+	}
+}
+
+//Draws one frame. Returns false once the window has been closed or the configured frame count is reached
+bool VulkanWrapper::tick()
 {
-	while (!glfwWindowShouldClose(m_window)) 
+	if (m_settings.frameCount > 0 && m_framesRendered >= m_settings.frameCount)
+	{
+		return false;
+	}
+
+	if (m_window)
+	{
+		if (glfwWindowShouldClose(m_window))
+		{
+			return false;
+		}
+	}
+
+	//Any limiter wait has to happen before input is polled, otherwise it only adds to the latency it is meant to cut
+	paceFrame();
+
+	if (m_window)
 	{
 		glfwPollEvents();
-		drawFrame();
 	}
-	vkDeviceWaitIdle(m_logicalDevice);
+
+	if (!m_runStarted)
+	{
+		m_runStart = std::chrono::steady_clock::now();
+		m_runStarted = true;
+	}
+
+	drawFrame();
+
+	if (m_runStats.firstFrameMs == 0.0 && m_framesRendered > 0)
+	{
+		m_runStats.firstFrameMs = m_timeline.elapsedMs();
+		std::cout << "First frame submitted after " << m_runStats.firstFrameMs << "ms" << std::endl;
+	}
+
+	m_runStats.frames = m_framesRendered;
+	m_runStats.runSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_runStart).count();
+	return true;
+}
+
+void VulkanWrapper::shutdown()
+{
+	if (m_logicalDevice != VK_NULL_HANDLE)
+	{
+		vkDeviceWaitIdle(m_logicalDevice);
+		printRunReport();
+	}
+	cleanUp();
+}
+
+void VulkanWrapper::printRunReport()
+{
+	double seconds = m_runStats.runSeconds;
+	std::cout << "Rendered " << m_framesRendered << " frames in " << seconds << "s";
+	if (seconds > 0.0)
+	{
+		std::cout << " (" << m_framesRendered / seconds << " fps)";
+	}
+	std::cout << std::endl;
+	std::cout << "Pacing: " << m_framesInFlight << " frames in flight, " << m_swapChainImages.size() << " images";
+	if (m_pacer.isEnabled())
+	{
+		std::cout << ", " << m_settings.targetLatencyMs << "ms latency target";
+	}
+	std::cout << std::endl;
+	double textureSeconds = m_textures.getUploadMs() / 1000.0;
+	m_runStats.textureUploadMBps = textureSeconds > 0.0 ? m_textures.getBytesUploaded() / (1024.0 * 1024.0) / textureSeconds : 0.0;
+	std::cout << "Geometry: " << m_vertexCount << " vertices x " << m_runStats.vertexStride << " bytes" << (m_settings.packedVertices ? " (packed)" : "")
+		<< ", " << m_runStats.vertexBytes / 1024 << " KiB, " << m_indexCount << " indices x " << m_runStats.indexSize << " bytes" << std::endl;
+	std::cout << "Textures: " << m_textures.getTextureCount() << " with " << m_textures.getSamplerCount() << " samplers, "
+		<< m_textures.getBytesUploaded() / 1024 << " KiB uploaded in " << m_textures.getUploadMs() << "ms (" << m_runStats.textureUploadMBps
+		<< " MiB/s), " << m_textures.getDecodeMs() << "ms decoding" << std::endl;
+	std::cout << "Draw calls: " << m_runStats.drawCalls << " per frame" << (m_gpuDriven ? " (GPU-driven, indirect count)" : "") << std::endl;
+	std::cout << "Descriptors: " << m_descriptorLayoutCache.getLayoutCount() << " layouts, " << m_descriptorSetCache.getSetCount() << " cached sets in "
+		<< m_descriptorAllocator.getPoolCount() << " pools" << std::endl;
+
+	//Device is idle, so every outstanding timestamp can be read back before reporting
+	m_profiler.resolveAllGpuTimings();
+	m_profiler.printSummary();
+
+	if (!m_settings.profileOutputPath.empty())
+	{
+		const std::string& path = m_settings.profileOutputPath;
+		bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+		if (json ? m_profiler.dumpJson(path) : m_profiler.dumpCsv(path))
+		{
+			std::cout << "Frame timings written to " << path << std::endl;
+		}
+	}
 }
 
 void VulkanWrapper::drawFrame()
 {
-	vkWaitForFences(m_logicalDevice, 1, &m_inFlightFences[m_currentFrame], VK_TRUE, UINT64_MAX);
-	vkResetFences(m_logicalDevice, 1, &m_inFlightFences[m_currentFrame]);
+	//Submit anything queued since the last frame and recycle finished upload batches
+	if (m_uploadManager.hasPendingWork())
+	{
+		m_uploadManager.flush();
+	}
+	m_uploadManager.collect();
+	m_deletionQueue.collect();
+	m_textures.update();
+
+	m_profiler.beginFrame(m_currentFrame);
+	if (m_pacer.isEnabled())
+	{
+		m_profiler.recordPhase(FrameProfiler::Pacing, m_pacingMs);
+	}
+
+	if (m_settings.headless)
+	{
+		drawOffscreenFrame();
+		return;
+	}
+
+	m_profiler.beginPhase(FrameProfiler::FenceWait);
+	m_frameTimeline.wait(m_frameValues[m_currentFrame]);
+	m_profiler.endPhase(FrameProfiler::FenceWait);
+	m_profiler.resolveGpuTimings();
 
 	uint32_t imageIndex;
+	m_profiler.beginPhase(FrameProfiler::Acquire);
 	VkResult result = vkAcquireNextImageKHR(m_logicalDevice, m_swapchain, UINT64_MAX, m_imageAvailableSemaphores[m_currentFrame], VK_NULL_HANDLE, &imageIndex);
+	m_profiler.endPhase(FrameProfiler::Acquire);
 	
-	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_framebufferResized) {
-		m_framebufferResized = false;
+	//Only bail out when no image was acquired. Nothing has to be undone: the timeline only moves when a frame is submitted.
+	//A suboptimal image is still rendered and presented, the swapchain is rebuilt after present.
+	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		recreateSwapchain();
 		return;
 	}
@@ -216,37 +450,23 @@ void VulkanWrapper::drawFrame()
 		throw std::runtime_error("failed to acquire swap chain image!");
 	}
 
-	vkResetFences(m_logicalDevice, 1, &m_inFlightFences[m_currentFrame]);
+	m_profiler.beginPhase(FrameProfiler::Record);
+	//The frame's timeline value has been reached, so everything it allocated last time round can be recycled in bulk
+	m_frames[m_currentFrame].reset();
+	VkCommandBuffer commandBuffer = m_frames[m_currentFrame].getCommandBuffer();
+	recordCommandBuffer(commandBuffer, imageIndex);
+	m_profiler.endPhase(FrameProfiler::Record);
 
-	vkResetCommandBuffer(m_commandBuffers[m_currentFrame], /*VkCommandBufferResetFlagBits*/ 0);
-	recordCommandBuffer(m_commandBuffers[m_currentFrame], imageIndex);
-
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-	VkSemaphore waitSemaphores[] = { m_imageAvailableSemaphores[m_currentFrame] };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
-
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &m_commandBuffers[m_currentFrame];
-
-	VkSemaphore signalSemaphores[] = { m_renderFinishedSemaphores[m_currentFrame] };
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
-
-	if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_inFlightFences[m_currentFrame]) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to submit draw command buffer!");
-	}
+	SubmitSemaphores semaphores;
+	semaphores.wait(m_imageAvailableSemaphores[m_currentFrame], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+	semaphores.signal(m_renderFinishedSemaphores[m_currentFrame]);
+	submitFrame(commandBuffer, semaphores);
 
 	VkPresentInfoKHR presentInfo{};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
 	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
+	presentInfo.pWaitSemaphores = &m_renderFinishedSemaphores[m_currentFrame];
 
 	VkSwapchainKHR swapChains[] = { m_swapchain };
 	presentInfo.swapchainCount = 1;
@@ -254,19 +474,120 @@ void VulkanWrapper::drawFrame()
 
 	presentInfo.pImageIndices = &imageIndex;
 
-	vkQueuePresentKHR(m_presentQueue, &presentInfo);
+	m_profiler.beginPhase(FrameProfiler::Present);
+	result = vkQueuePresentKHR(m_presentQueue, &presentInfo);
+	m_profiler.endPhase(FrameProfiler::Present);
+
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_framebufferResized)
+	{
+		m_framebufferResized = false;
+		recreateSwapchain();
+	}
+	else if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to present swap chain image!");
+	}
+
+	m_profiler.endFrame();
+	m_currentFrame = (m_currentFrame + 1) % m_framesInFlight;
+	m_framesRendered++;
+}
+
+//Headless equivalent of drawFrame: no acquire or present, each frame renders into the next image of the offscreen ring
+void VulkanWrapper::drawOffscreenFrame()
+{
+	m_profiler.beginPhase(FrameProfiler::FenceWait);
+	m_frameTimeline.wait(m_frameValues[m_currentFrame]);
+	m_profiler.endPhase(FrameProfiler::FenceWait);
+	m_profiler.resolveGpuTimings();
+
+	uint32_t imageIndex = m_offscreenImageIndex;
+	m_offscreenImageIndex = (m_offscreenImageIndex + 1) % static_cast<uint32_t>(m_swapChainImages.size());
+
+	m_profiler.beginPhase(FrameProfiler::Record);
+	m_frames[m_currentFrame].reset();
+	VkCommandBuffer commandBuffer = m_frames[m_currentFrame].getCommandBuffer();
+	recordCommandBuffer(commandBuffer, imageIndex);
+	m_profiler.endPhase(FrameProfiler::Record);
+
+	SubmitSemaphores semaphores;
+	submitFrame(commandBuffer, semaphores);
+
+	m_profiler.endFrame();
+	m_currentFrame = (m_currentFrame + 1) % m_framesInFlight;
+	m_framesRendered++;
+}
+
+//Adds what every frame submission shares to the caller's semaphores: a GPU side wait for uploads that have not landed
+//yet, in place of a CPU wait, and the frame timeline value that marks this slot's resources as reusable
+void VulkanWrapper::submitFrame(VkCommandBuffer commandBuffer, SubmitSemaphores& semaphores)
+{
+	uint64_t uploadTicket = m_uploadManager.getLastTicket();
+	if (!m_uploadManager.isComplete(uploadTicket))
+	{
+		//Transfer covers the texture mip blits recorded at the start of the frame
+		semaphores.wait(m_uploadManager.getTimeline(), VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, uploadTicket);
+	}
+
+	uint64_t frameValue = m_frameTimeline.advance();
+	semaphores.signal(m_frameTimeline.getHandle(), frameValue);
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	semaphores.apply(submitInfo);
+
+	m_profiler.beginPhase(FrameProfiler::Submit);
+	if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit draw command buffer!");
+	}
+	m_profiler.endPhase(FrameProfiler::Submit);
+	m_pacer.frameSubmitted();
+
+	m_frameValues[m_currentFrame] = frameValue;
+}
+
+//Runs before input is polled. Also checks whether the previous frame has finished yet, which gives the profiler a
+//much tighter latency measurement than waiting for that frame's slot to come round again
+void VulkanWrapper::paceFrame()
+{
+	if (m_frameValues.empty())
+	{
+		return;
+	}
 
-	m_currentFrame = (m_currentFrame + 1) % m_maxFramesInFlight;
+	uint32_t previousFrame = (m_currentFrame + m_framesInFlight - 1) % m_framesInFlight;
+	uint64_t previousValue = m_frameValues[previousFrame];
+
+	//Only the part of the frame before submit delays the GPU, present may block on vsync
+	double record = m_profiler.getLatest(FrameProfiler::Record);
+	double submit = m_profiler.getLatest(FrameProfiler::Submit);
+	double cpuMs = record >= 0.0 && submit >= 0.0 ? record + submit : -1.0;
+	m_pacingMs = m_pacer.wait(m_frameTimeline, previousValue, cpuMs, m_profiler.getLatest(FrameProfiler::Gpu));
+
+	if (m_frameTimeline.isComplete(previousValue))
+	{
+		m_profiler.frameCompleted(previousFrame);
+	}
 }
 
 
 std::vector<const char*> VulkanWrapper::getRequiredExtensions()
 {
-	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	std::vector<const char*> extensions;
 
-	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	//Headless runs never create a surface, so the window system extensions are not needed
+	if (!m_settings.headless)
+	{
+		uint32_t glfwExtensionCount = 0;
+		const char** glfwExtensions;
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+		extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	}
 
 	if (enableValidationLayers) {
 		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -275,6 +596,16 @@ std::vector<const char*> VulkanWrapper::getRequiredExtensions()
 	return extensions;
 }
 
+std::vector<const char*> VulkanWrapper::getRequiredDeviceExtensions()
+{
+	if (m_settings.headless)
+	{
+		return {};
+	}
+
+	return m_deviceExtensions;
+}
+
 void VulkanWrapper::setupDebugMessager()
 {
 	if (!enableValidationLayers)
@@ -328,9 +659,28 @@ bool VulkanWrapper::isDeviceSuitable(VkPhysicalDevice device)
 
 	QueueFamilyIndices indices = findQueueFamilies(device);
 
+	//Frame and upload synchronisation is built on timeline semaphores, core since Vulkan 1.2
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device, &properties);
+
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 features{};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &features12;
+	if (properties.apiVersion < VK_API_VERSION_1_2)
+	{
+		return false;
+	}
+	vkGetPhysicalDeviceFeatures2(device, &features);
+	if (!features12.timelineSemaphore)
+	{
+		return false;
+	}
+
 	bool extensionsSupported = checkDeviceExtensionSupport(device);
-	bool swapChainAdequate = false;
-	if (extensionsSupported) {
+	bool swapChainAdequate = m_settings.headless;
+	if (extensionsSupported && !m_settings.headless) {
 		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 	}
@@ -349,31 +699,41 @@ VulkanWrapper::QueueFamilyIndices VulkanWrapper::findQueueFamilies(VkPhysicalDev
 	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
 	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
-	int i = 0;
-	for (const auto& queueFamily : queueFamilies) {
-		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-			indices.graphicsFamily = i;
-		}
+	for (uint32_t i = 0; i < queueFamilyCount; i++) {
+		VkQueueFlags flags = queueFamilies[i].queueFlags;
+		bool graphics = (flags & VK_QUEUE_GRAPHICS_BIT) != 0;
 
 		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &presentSupport);
+		if (m_settings.headless) {
+			//Nothing is presented when headless, the graphics queue stands in for the present queue
+			presentSupport = graphics;
+		}
+		else {
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &presentSupport);
+		}
 
-		if (presentSupport) {
+		//A single family that can both draw and present avoids sharing swapchain images across families
+		bool shared = indices.graphicsFamily.has_value() && indices.graphicsFamily == indices.presentFamily;
+		if (graphics && presentSupport && !shared) {
+			indices.graphicsFamily = i;
 			indices.presentFamily = i;
 		}
-
-		if (indices.isComplete()) {
-			break;
+		if (graphics && !indices.graphicsFamily.has_value()) {
+			indices.graphicsFamily = i;
+		}
+		if (presentSupport && !indices.presentFamily.has_value()) {
+			indices.presentFamily = i;
 		}
 
-		i++;
+		//Compute without graphics is an async compute engine, transfer without either is a DMA engine
+		if ((flags & VK_QUEUE_COMPUTE_BIT) && !graphics && !indices.computeFamily.has_value()) {
+			indices.computeFamily = i;
+		}
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && !indices.transferFamily.has_value()) {
+			indices.transferFamily = i;
+		}
 	}
 
-	std::optional<uint32_t> graphicsFamily;
-	std::cout << std::boolalpha << graphicsFamily.has_value() << std::endl; // false
-	graphicsFamily = 0;
-	std::cout << std::boolalpha << graphicsFamily.has_value() << std::endl; // true
-
 	return indices;
 }
 
@@ -381,28 +741,108 @@ void VulkanWrapper::createLogicalDevice()
 {
 	QueueFamilyIndices indices = findQueueFamilies(m_physicalDevice);
 
-	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	//Graphics and present go first at full priority. Every graphics family supports compute and transfer, so when no
+	//dedicated family exists those queues fall back to the graphics family, taking a second slot if it has one
+	std::map<uint32_t, std::vector<float>> queuePriorities;
+	auto requestQueue = [&](uint32_t family, float priority) -> uint32_t {
+		std::vector<float>& priorities = queuePriorities[family];
+		if (priorities.size() < queueFamilies[family].queueCount) {
+			priorities.push_back(priority);
+		}
+		return static_cast<uint32_t>(priorities.size() - 1);
+	};
 
-	float queuePriority = 1.0f;
-	for (uint32_t queueFamily : uniqueQueueFamilies) {
+	requestQueue(indices.graphicsFamily.value(), 1.0f);
+	if (indices.presentFamily != indices.graphicsFamily) {
+		requestQueue(indices.presentFamily.value(), 1.0f);
+	}
+
+	if (!m_settings.useAsyncComputeQueue || !indices.computeFamily.has_value()) {
+		indices.computeFamily = indices.graphicsFamily;
+	}
+	indices.computeQueueIndex = m_settings.useAsyncComputeQueue ? requestQueue(indices.computeFamily.value(), 0.5f) : 0;
+
+	//Uploads are background work, they should not hold up frame submission
+	if (!m_settings.useTransferQueue || !indices.transferFamily.has_value()) {
+		indices.transferFamily = indices.graphicsFamily;
+	}
+	indices.transferQueueIndex = m_settings.useTransferQueue ? requestQueue(indices.transferFamily.value(), 0.25f) : 0;
+
+	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+	for (const auto& family : queuePriorities) {
 		VkDeviceQueueCreateInfo queueCreateInfo{};
 		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-		queueCreateInfo.queueFamilyIndex = queueFamily;
-		queueCreateInfo.queueCount = 1;
-		queueCreateInfo.pQueuePriorities = &queuePriority;
+		queueCreateInfo.queueFamilyIndex = family.first;
+		queueCreateInfo.queueCount = static_cast<uint32_t>(family.second.size());
+		queueCreateInfo.pQueuePriorities = family.second.data();
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
-	VkPhysicalDeviceFeatures deviceFeatures{};
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	features12.timelineSemaphore = VK_TRUE;
+
+	//Anisotropic filtering is optional, textures fall back to plain trilinear
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(m_physicalDevice, &supportedFeatures);
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+	m_maxAnisotropy = supportedFeatures.samplerAnisotropy ? (std::min)(deviceProperties.limits.maxSamplerAnisotropy, 16.0f) : 1.0f;
+
+	//Bindless is opt-in, a device missing any descriptor indexing feature it relies on, or whose update-after-bind
+	//limits cannot hold the heap, keeps classic sets
+	m_bindless = m_settings.bindless && supportsBindless(m_physicalDevice);
+	if (m_settings.bindless && !m_bindless)
+	{
+		std::cout << "Descriptor indexing not supported or too limited for the bindless heap, falling back to classic descriptor sets" << std::endl;
+	}
+	m_instanceBatcher.init(!m_bindless);
+
+	//GPU-driven mode is opt-in as well, without indirect count draws the CPU keeps recording every draw
+	m_gpuDriven = m_settings.gpuDriven && supportsGpuDriven(m_physicalDevice);
+	if (m_settings.gpuDriven && !m_gpuDriven)
+	{
+		std::cout << "Indirect count draws not supported, recording draws on the CPU" << std::endl;
+	}
+	if (m_gpuDriven)
+	{
+		features12.drawIndirectCount = VK_TRUE;
+	}
+	if (m_bindless)
+	{
+		features12.descriptorIndexing = VK_TRUE;
+		features12.runtimeDescriptorArray = VK_TRUE;
+		features12.descriptorBindingPartiallyBound = VK_TRUE;
+		features12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+		features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		features12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+		features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	}
+
+	//Features go through the pNext chain, so pEnabledFeatures has to stay null
+	VkPhysicalDeviceFeatures2 deviceFeatures{};
+	deviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	deviceFeatures.pNext = &features12;
+	deviceFeatures.features.samplerAnisotropy = supportedFeatures.samplerAnisotropy;
+	deviceFeatures.features.multiDrawIndirect = m_gpuDriven ? VK_TRUE : VK_FALSE;
+	deviceFeatures.features.drawIndirectFirstInstance = m_gpuDriven ? VK_TRUE : VK_FALSE;
+	//The bindless shaders index the material buffer array with a per-draw value
+	deviceFeatures.features.shaderStorageBufferArrayDynamicIndexing = m_bindless ? VK_TRUE : VK_FALSE;
+	auto deviceExtensions = getRequiredDeviceExtensions();
 
 	VkDeviceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	createInfo.pNext = &deviceFeatures;
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-	createInfo.pEnabledFeatures = &deviceFeatures;
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(m_deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = m_deviceExtensions.data();
+	createInfo.pEnabledFeatures = nullptr;
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
 	if (enableValidationLayers) {
 		createInfo.enabledLayerCount = static_cast<uint32_t>(m_validationLayers.size());
@@ -418,10 +858,34 @@ void VulkanWrapper::createLogicalDevice()
 
 	vkGetDeviceQueue(m_logicalDevice, indices.graphicsFamily.value(), 0, &m_graphicsQueue);
 	vkGetDeviceQueue(m_logicalDevice, indices.presentFamily.value(), 0, &m_presentQueue);
+	vkGetDeviceQueue(m_logicalDevice, indices.computeFamily.value(), indices.computeQueueIndex, &m_computeQueue);
+	vkGetDeviceQueue(m_logicalDevice, indices.transferFamily.value(), indices.transferQueueIndex, &m_transferQueue);
+
+	std::cout << "Queues: graphics family " << indices.graphicsFamily.value()
+		<< ", present family " << indices.presentFamily.value()
+		<< ", compute family " << indices.computeFamily.value() << " (queue " << indices.computeQueueIndex << ")"
+		<< ", transfer family " << indices.transferFamily.value() << " (queue " << indices.transferQueueIndex << ")" << std::endl;
+
+	m_queueFamilies = indices;
+}
+
+void VulkanWrapper::createAllocator()
+{
+	m_allocator.init(m_logicalDevice, m_physicalDevice);
+}
+
+void VulkanWrapper::createPipelineCache()
+{
+	m_pipelineCache.load(m_logicalDevice, m_physicalDevice, m_settings.pipelineCachePath);
 }
 
 void VulkanWrapper::createSurface()
 {
+	if (m_settings.headless)
+	{
+		return;
+	}
+
 	if (glfwCreateWindowSurface(m_vkInstance, m_window, nullptr, &m_surface) != VK_SUCCESS) 
 	{
 		throw std::runtime_error("failed to create window surface!");
@@ -436,7 +900,8 @@ bool VulkanWrapper::checkDeviceExtensionSupport(VkPhysicalDevice device)
 	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-	std::set<std::string> requiredExtensions(m_deviceExtensions.begin(), m_deviceExtensions.end());
+	auto deviceExtensions = getRequiredDeviceExtensions();
+	std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
 
 	for (const auto& extension : availableExtensions) {
 		requiredExtensions.erase(extension.extensionName);
@@ -481,16 +946,34 @@ VkSurfaceFormatKHR VulkanWrapper::chooseSwapSurfaceFormat(const std::vector<VkSu
 	return availableFormats[0];
 }
 
+static const char* getPresentModeName(VkPresentModeKHR presentMode)
+{
+	switch (presentMode)
+	{
+	case VK_PRESENT_MODE_FIFO_KHR:
+		return "FIFO";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+		return "FIFO_RELAXED";
+	case VK_PRESENT_MODE_MAILBOX_KHR:
+		return "MAILBOX";
+	case VK_PRESENT_MODE_IMMEDIATE_KHR:
+		return "IMMEDIATE";
+	default:
+		return "unknown";
+	}
+}
+
 VkPresentModeKHR VulkanWrapper::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) 
 {
 	for (const auto& availablePresentMode : availablePresentModes)
 	{
-		if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+		if (availablePresentMode == m_settings.presentMode)
 		{
 			return availablePresentMode;
 		}
 	}
 
+	std::cout << "Present mode " << getPresentModeName(m_settings.presentMode) << " not supported, falling back to FIFO" << std::endl;
 	return VK_PRESENT_MODE_FIFO_KHR;
 }
 
@@ -525,7 +1008,8 @@ void VulkanWrapper::createSwapChain()
 	VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
 	VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-	uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+	uint32_t imageCount = m_settings.swapchainImageCount > 0 ? m_settings.swapchainImageCount : swapChainSupport.capabilities.minImageCount + 1;
+	imageCount = (std::max)(imageCount, swapChainSupport.capabilities.minImageCount);
 
 	if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) 
 	{
@@ -542,7 +1026,7 @@ void VulkanWrapper::createSwapChain()
 	createInfo.imageArrayLayers = 1;
 	createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-	QueueFamilyIndices indices = findQueueFamilies(m_physicalDevice);
+	const QueueFamilyIndices& indices = m_queueFamilies;
 	uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
 
 	if (indices.graphicsFamily != indices.presentFamily) {
@@ -560,7 +1044,8 @@ void VulkanWrapper::createSwapChain()
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	createInfo.presentMode = presentMode;
 	createInfo.clipped = VK_TRUE;
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	//Hand the previous swapchain over on resize so the driver can recycle its images, the caller retires it afterwards
+	createInfo.oldSwapchain = m_swapchain;
 
 	if (vkCreateSwapchainKHR(m_logicalDevice, &createInfo, nullptr, &m_swapchain) != VK_SUCCESS)
 	{
@@ -575,6 +1060,27 @@ void VulkanWrapper::createSwapChain()
 	m_swapChainExtent = extent;
 }
 
+//Headless replacement for the swapchain: a small ring of device local colour images that frames are rendered into.
+//They are left in TRANSFER_SRC layout by the render pass so a frame can be copied back for inspection.
+void VulkanWrapper::createOffscreenTargets()
+{
+	m_swapChainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	m_swapChainExtent = { m_windowWidth, m_windowHeight };
+
+	uint32_t imageCount = (std::max)(m_settings.offscreenImageCount, 1u);
+	m_swapChainImages.resize(imageCount);
+	m_offscreenImageMemory.resize(imageCount);
+
+	for (uint32_t i = 0; i < imageCount; i++)
+	{
+		createImage(m_swapChainExtent.width, m_swapChainExtent.height, m_swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			m_swapChainImages[i], m_offscreenImageMemory[i]);
+	}
+
+	m_offscreenImageIndex = 0;
+}
+
 void VulkanWrapper::createImageViews()
 {
 	m_swapChainImageViews.resize(m_swapChainImages.size());
@@ -605,17 +1111,35 @@ void VulkanWrapper::createImageViews()
 
 void VulkanWrapper::createGraphicsPipeline()
 {
-	auto vertShaderCode = readFile("shaders/vert.spv");
-	auto fragShaderCode = readFile("shaders/frag.spv");
+	bool instanced = m_settings.transformPath == TransformPath::InstanceAttributes;
+	VkShaderModule vertShaderModule = m_shaders.createModule(m_logicalDevice, instanced ? "shaders/vert_instanced.spv" : "shaders/vert.spv");
+	VkShaderModule fragShaderModule = m_shaders.createModule(m_logicalDevice, m_bindless ? "shaders/frag_bindless.spv" : "shaders/frag.spv");
 
-	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-	VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+	//TRANSFORM_PATH in shader.vert, the enum values match the shader's numbering, and OCTAHEDRAL_NORMALS. The instanced
+	//shader only declares the latter, entries for constants a shader lacks are ignored
+	struct VertexConstants
+	{
+		int32_t transformPath;
+		VkBool32 octahedralNormals;
+	};
+	VertexConstants vertexConstants{ static_cast<int32_t>(m_settings.transformPath), m_settings.packedVertices ? VK_TRUE : VK_FALSE };
+	VkSpecializationMapEntry specializationEntries[] = {
+		{ 0, offsetof(VertexConstants, transformPath), sizeof(int32_t) },
+		{ 1, offsetof(VertexConstants, octahedralNormals), sizeof(VkBool32) },
+	};
+
+	VkSpecializationInfo specializationInfo{};
+	specializationInfo.mapEntryCount = 2;
+	specializationInfo.pMapEntries = specializationEntries;
+	specializationInfo.dataSize = sizeof(vertexConstants);
+	specializationInfo.pData = &vertexConstants;
 
 	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
 	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
 	vertShaderStageInfo.module = vertShaderModule;
 	vertShaderStageInfo.pName = "main";
+	vertShaderStageInfo.pSpecializationInfo = &specializationInfo;
 
 	VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
 	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -627,14 +1151,26 @@ void VulkanWrapper::createGraphicsPipeline()
 
 
 
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
+	//Both vertex structs feed the same shader locations, only the formats differ
+	auto vertexAttributes = m_settings.packedVertices ? VertexLayout<PackedVertex>::getAttributeDescriptions() : VertexLayout<Vertex>::getAttributeDescriptions();
+	std::vector<VkVertexInputBindingDescription> bindingDescriptions = {
+		m_settings.packedVertices ? VertexLayout<PackedVertex>::getBindingDescription() : VertexLayout<Vertex>::getBindingDescription()
+	};
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions(vertexAttributes.begin(), vertexAttributes.end());
+
+	//Instance attributes step once per instance from binding 1 and carry on from the last vertex location
+	if (instanced)
+	{
+		auto instanceAttributes = VertexLayout<InstanceData>::getAttributeDescriptions(1, static_cast<uint32_t>(vertexAttributes.size()));
+		bindingDescriptions.push_back(VertexLayout<InstanceData>::getBindingDescription(1, VK_VERTEX_INPUT_RATE_INSTANCE));
+		attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributes.begin(), instanceAttributes.end());
+	}
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
 	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+	vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
 	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
 	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
@@ -642,24 +1178,21 @@ void VulkanWrapper::createGraphicsPipeline()
 	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)m_swapChainExtent.width;
-	viewport.height = (float)m_swapChainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor{};
-	scissor.offset = { 0, 0 };
-	scissor.extent = m_swapChainExtent;
-
+	//Viewport and scissor are set in recordCommandBuffer so the pipeline does not depend on the swapchain extent
 	VkPipelineViewportStateCreateInfo viewportState{};
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
 	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
+
+	std::vector<VkDynamicState> dynamicStates = {
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR
+	};
+
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicState.pDynamicStates = dynamicStates.data();
 
 	VkPipelineRasterizationStateCreateInfo rasterizer{};
 	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -668,7 +1201,8 @@ void VulkanWrapper::createGraphicsPipeline()
 	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
 	rasterizer.lineWidth = 1.0f;
 	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	//The projection flips Y, which reverses the winding of the geometry as written
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 	rasterizer.depthBiasEnable = VK_FALSE;
 
 	VkPipelineMultisampleStateCreateInfo multisampling{};
@@ -693,9 +1227,21 @@ void VulkanWrapper::createGraphicsPipeline()
 
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 1;
-	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
+	VkDescriptorSetLayout setLayouts[] = { m_descriptorSetLayout, m_materialSetLayout };
+	pipelineLayoutInfo.setLayoutCount = 2;
+
+	//The bindless fragment shader gets its heap indices right after the vertex stage's range
+	VkPushConstantRange pushConstantRanges[2]{};
+	pushConstantRanges[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRanges[0].offset = 0;
+	pushConstantRanges[0].size = sizeof(ObjectUniforms);
+	pushConstantRanges[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	pushConstantRanges[1].offset = sizeof(ObjectUniforms);
+	pushConstantRanges[1].size = sizeof(BindlessIndices);
+
+	pipelineLayoutInfo.pSetLayouts = setLayouts;
+	pipelineLayoutInfo.pushConstantRangeCount = m_bindless ? 2 : 1;
+	pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges;
 
 	if (vkCreatePipelineLayout(m_logicalDevice, &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create pipeline layout!");
@@ -711,17 +1257,21 @@ void VulkanWrapper::createGraphicsPipeline()
 	pipelineInfo.pRasterizationState = &rasterizer;
 	pipelineInfo.pMultisampleState = &multisampling;
 	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
 	pipelineInfo.layout = m_pipelineLayout;
 	pipelineInfo.renderPass = m_renderPass;
 	pipelineInfo.subpass = 0;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-	if (vkCreateGraphicsPipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_graphicsPipeline) != VK_SUCCESS) {
+	auto pipelineStart = std::chrono::steady_clock::now();
+
+	if (vkCreateGraphicsPipelines(m_logicalDevice, m_pipelineCache.getHandle(), 1, &pipelineInfo, nullptr, &m_graphicsPipeline) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create graphics pipeline!");
 	}
 	else
 	{
-		printf("Successfully Create Graphics Pipleine!!");
+		double pipelineMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pipelineStart).count();
+		printf("Successfully Create Graphics Pipleine!! (%.3fms, %s cache)\n", pipelineMs, m_pipelineCache.isWarm() ? "warm" : "cold");
 	}
 
 	vkDestroyShaderModule(m_logicalDevice, fragShaderModule, nullptr);
@@ -729,58 +1279,22 @@ void VulkanWrapper::createGraphicsPipeline()
 }
 
 
-std::vector<char> VulkanWrapper::readFile(const std::string& filename)
+void VulkanWrapper::createRenderPass()
 {
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-	if (!file.is_open())
-	{
-		throw std::runtime_error("failed to open file!");
-	}
+	VkAttachmentDescription colorAttachment{};
+	colorAttachment.format = m_swapChainImageFormat;
+	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachment.finalLayout = m_settings.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> buffer(fileSize);
-
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
-	file.close();
-
-	return buffer;
-
-}
-
-VkShaderModule VulkanWrapper::createShaderModule(const std::vector<char>& code)
-{
-	VkShaderModuleCreateInfo createInfo{};
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-	VkShaderModule shaderModule;
-	if (vkCreateShaderModule(m_logicalDevice, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) 
-	{
-		throw std::runtime_error("failed to create shader module!");
-	}
-
-	return shaderModule;
-}
-
-void VulkanWrapper::createRenderPass()
-{
-	VkAttachmentDescription colorAttachment{};
-	colorAttachment.format = m_swapChainImageFormat;
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-	VkAttachmentReference colorAttachmentRef{};
-	colorAttachmentRef.attachment = 0;
-	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	VkAttachmentReference colorAttachmentRef{};
+	colorAttachmentRef.attachment = 0;
+	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	VkSubpassDescription subpass{};
 	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
@@ -801,7 +1315,8 @@ void VulkanWrapper::createRenderPass()
 	renderPassInfo.pAttachments = &colorAttachment;
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
-
+	renderPassInfo.dependencyCount = 1;
+	renderPassInfo.pDependencies = &dependency;
 
 	if (vkCreateRenderPass(m_logicalDevice, &renderPassInfo, nullptr, &m_renderPass) != VK_SUCCESS) 
 	{
@@ -835,116 +1350,185 @@ void VulkanWrapper::createFrameBuffers()
 	}
 }
 
-void VulkanWrapper::createCommandBuffers()
+void VulkanWrapper::createFrameContexts()
 {
-	m_commandBuffers.resize(m_maxFramesInFlight);
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = m_commandPool;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = (uint32_t)m_commandBuffers.size();
-
-	if (vkAllocateCommandBuffers(m_logicalDevice, &allocInfo, m_commandBuffers.data()) != VK_SUCCESS)
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+	m_uniformAlignment = (std::max)(properties.limits.minUniformBufferOffsetAlignment, VkDeviceSize(1));
+	m_storageAlignment = (std::max)(properties.limits.minStorageBufferOffsetAlignment, VkDeviceSize(1));
+
+	//The scratch buffer is the uniform ring, so it has to hold at least one frame's constants for every draw, and the
+	//storage binding's range covers every draw whichever path is in use
+	VkDeviceSize drawCount = (std::max)(m_settings.drawCount, 1u);
+	auto aligned = [this](VkDeviceSize size) { return (size + m_uniformAlignment - 1) / m_uniformAlignment * m_uniformAlignment; };
+	VkDeviceSize uniformBytes = aligned(sizeof(UniformBufferObject)) + m_storageAlignment + (std::max)(aligned(sizeof(ObjectUniforms)), VkDeviceSize(sizeof(ObjectUniforms))) * drawCount;
+	if (m_gpuDriven)
 	{
-		throw std::runtime_error("failed to allocate command buffers!");
+		uniformBytes += m_uniformAlignment + sizeof(CullUniforms);
 	}
-}
-
+	VkDeviceSize scratchSize = (std::max)(m_settings.frameScratchSize, uniformBytes);
 
+	const VkDescriptorType ringTypes[] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC };
+	const VkDeviceSize ringRanges[] = { sizeof(UniformBufferObject), sizeof(ObjectUniforms), sizeof(ObjectUniforms) * drawCount };
 
-void VulkanWrapper::createCommandPool()
-{
-	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(m_physicalDevice);
+	m_frames.resize(m_framesInFlight);
+	for (FrameContext& frame : m_frames)
+	{
+		frame.init(m_logicalDevice, m_allocator, m_descriptorLayoutCache, m_queueFamilies.graphicsFamily.value(), m_settings.recordThreads, scratchSize);
+		frame.createUniformSet(m_descriptorSetCache, m_descriptorSetLayout, ringTypes, ringRanges, 3);
+	}
 
-	VkCommandPoolCreateInfo poolInfo{};
-	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+	//Sized for the built-in scene, drawInstances() grows them on demand
+	if (m_settings.transformPath == TransformPath::InstanceAttributes)
+	{
+		m_instanceStreams.resize(m_framesInFlight);
+		for (InstanceStream& stream : m_instanceStreams)
+		{
+			stream.capacity = sizeof(InstanceData) * drawCount;
+			createBuffer(stream.capacity, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stream.buffer, stream.memory);
+		}
+	}
+}
 
-	if (vkCreateCommandPool(m_logicalDevice, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS) 
+void VulkanWrapper::destroyFrameContexts()
+{
+	for (InstanceStream& stream : m_instanceStreams)
 	{
-		throw std::runtime_error("failed to create command pool!");
+		destroyBuffer(stream.buffer, stream.memory);
 	}
+	m_instanceStreams.clear();
+	for (FrameContext& frame : m_frames)
+	{
+		frame.destroy();
+	}
+	m_frames.clear();
 }
 
-void VulkanWrapper::createVertexBuffers()
+void VulkanWrapper::createUploadManager()
 {
-	VkDeviceSize bufferSize = sizeof(m_vertices[0]) * m_vertices.size();
+	m_uploadManager.init(m_logicalDevice, m_allocator, m_transferQueue, m_queueFamilies.transferFamily.value());
+}
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+void VulkanWrapper::createFrameProfiler()
+{
+	m_profiler.init(m_logicalDevice, m_physicalDevice, m_queueFamilies.graphicsFamily.value(), m_framesInFlight);
+}
 
-	void* data;
-	vkMapMemory(m_logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, m_vertices.data(), (size_t)bufferSize);
-	vkUnmapMemory(m_logicalDevice, stagingBufferMemory);
+//Both geometry uploads land in the same batch, submitted when createTexureImage() starts the textures' own. A loaded mesh is
+//copied straight from its mapping into the staging ring, it was baked in the right format
+void VulkanWrapper::createVertexBuffers()
+{
+	std::vector<PackedVertex> packedVertices;
+	const void* vertexData = m_vertices.data();
+	VkDeviceSize bufferSize = sizeof(m_vertices[0]) * m_vertices.size();
+	m_vertexCount = static_cast<uint32_t>(m_vertices.size());
+	if (m_mesh.isOpen())
+	{
+		vertexData = m_mesh.getVertexData();
+		bufferSize = m_mesh.getVertexDataSize();
+		m_vertexCount = static_cast<uint32_t>(m_mesh.getHeader().vertexCount);
+	}
+	else if (m_settings.packedVertices)
+	{
+		for (const Vertex& vertex : m_vertices)
+		{
+			packedVertices.push_back(packVertex(vertex));
+		}
+		vertexData = packedVertices.data();
+		bufferSize = sizeof(PackedVertex) * packedVertices.size();
+	}
+	m_runStats.vertexStride = m_settings.packedVertices ? sizeof(PackedVertex) : sizeof(Vertex);
+	m_runStats.vertexBytes = bufferSize;
 
 	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_vertexBuffer, m_vertexBufferMemory);
-	copyBuffer(stagingBuffer, m_vertexBuffer, bufferSize);
-
-	vkDestroyBuffer(m_logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(m_logicalDevice, stagingBufferMemory, nullptr);
+	m_uploadManager.uploadBuffer(m_vertexBuffer, 0, vertexData, bufferSize);
 }
 
 void VulkanWrapper::createIndexBuffer()
 {
+	const void* indexData = m_indices.data();
 	VkDeviceSize bufferSize = sizeof(m_indices[0]) * m_indices.size();
+	m_indexCount = static_cast<uint32_t>(m_indices.size());
+	m_indexType = VK_INDEX_TYPE_UINT16;
+	if (m_mesh.isOpen())
+	{
+		indexData = m_mesh.getIndexData();
+		bufferSize = m_mesh.getIndexDataSize();
+		m_indexCount = static_cast<uint32_t>(m_mesh.getHeader().indexCount);
+		m_indexType = m_mesh.getHeader().indexSize == sizeof(uint32_t) ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
+	}
+	m_runStats.indexSize = m_indexType == VK_INDEX_TYPE_UINT32 ? sizeof(uint32_t) : sizeof(uint16_t);
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	MeshBounds bounds{ m_vertices[0].pos, m_vertices[0].pos };
+	for (const Vertex& vertex : m_vertices)
+	{
+		bounds.min = glm::min(bounds.min, vertex.pos);
+		bounds.max = glm::max(bounds.max, vertex.pos);
+	}
+	if (m_mesh.isOpen())
+	{
+		bounds = m_mesh.getHeader().bounds;
+	}
 
-	void* data;
-	vkMapMemory(m_logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, m_indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(m_logicalDevice, stagingBufferMemory);
+	m_meshRanges.assign(1, MeshRange{ 0, m_indexCount, bounds });
+	for (uint64_t i = 0; m_mesh.isOpen() && i < m_mesh.getHeader().submeshCount; i++)
+	{
+		const Submesh& submesh = m_mesh.getSubmeshes()[i];
+		m_meshRanges.push_back(MeshRange{ submesh.firstIndex, submesh.indexCount, submesh.bounds });
+	}
 
 	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indexBuffer, m_indexBufferMemory);
-
-	copyBuffer(stagingBuffer, m_indexBuffer, bufferSize);
-
-	vkDestroyBuffer(m_logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(m_logicalDevice, stagingBufferMemory, nullptr);
+	m_uploadManager.uploadBuffer(m_indexBuffer, 0, indexData, bufferSize);
 }
 
-
-void VulkanWrapper::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) 
+//Maps the baked mesh, baking it first if only the source exists. Nothing is parsed here, the header is validated
+//and the streams are uploaded from the mapping by createVertexBuffers/createIndexBuffer
+void VulkanWrapper::loadMesh()
 {
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = m_commandPool;
-	allocInfo.commandBufferCount = 1;
+	if (m_settings.meshPath.empty())
+	{
+		return;
+	}
 
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(m_logicalDevice, &allocInfo, &commandBuffer);
+	MeshBaker::Options options;
+	options.packedVertices = m_settings.packedVertices;
+	options.optimize = m_settings.optimizeMeshes;
+	options.reduceOverdraw = m_settings.reduceOverdraw;
+	m_mesh.open(MeshBaker::bake(m_settings.meshPath, options));
+	if (m_mesh.isPacked() != m_settings.packedVertices)
+	{
+		throw std::runtime_error("failed to load mesh " + m_settings.meshPath + ", it was baked with the other vertex format!");
+	}
 
-	VkCommandBufferBeginInfo beginInfo{};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	const MeshFile::Header& header = m_mesh.getHeader();
+	glm::vec3 center = (header.bounds.min + header.bounds.max) * 0.5f;
+	float radius = glm::length(header.bounds.max - header.bounds.min) * 0.5f;
+	m_meshTransform = glm::scale(glm::mat4(1.0f), glm::vec3(radius > 0.0f ? 1.0f / radius : 1.0f)) * glm::translate(glm::mat4(1.0f), -center);
+	m_texCoordTransform = m_mesh.getTexCoordTransform();
 
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	std::cout << "Mesh: " << m_settings.meshPath << ", " << header.indexCount / 3 << " triangles, " << header.vertexCount << " vertices, "
+		<< header.submeshCount << " submeshes, " << m_mesh.getFileSize() / 1024 << " KiB mapped" << std::endl;
+}
 
+//Recorded into the current upload batch, the copy is only guaranteed done once that batch's ticket completes
+void VulkanWrapper::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) 
+{
 	VkBufferCopy copyRegion{};
 	copyRegion.size = size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-	vkEndCommandBuffer(commandBuffer);
-
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-
-	vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(m_graphicsQueue);
-
-	vkFreeCommandBuffers(m_logicalDevice, m_commandPool, 1, &commandBuffer);
+	m_uploadManager.copyBuffer(srcBuffer, dstBuffer, copyRegion);
 }
 
+
 void VulkanWrapper::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) 
 {
+	writeFrameUniforms();
+
+	bool useSecondaries = !m_secondaryDrawCounts.empty();
+	if (useSecondaries)
+	{
+		recordSecondaryCommandBuffers(imageIndex);
+	}
+
 	VkCommandBufferBeginInfo beginInfo{};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	beginInfo.flags = 0; // Optional
@@ -966,47 +1550,393 @@ void VulkanWrapper::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t
 	renderPassInfo.clearValueCount = 1;
 	renderPassInfo.pClearValues = &clearColor;
 
-	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	m_profiler.writeGpuBegin(commandBuffer);
+
+	//Mip generation for textures uploaded since the last frame, has to happen outside the render pass, as does culling
+	m_textures.recordPendingWork(commandBuffer);
+	if (m_gpuDriven)
+	{
+		recordCulling(commandBuffer);
+	}
+
+	if (useSecondaries)
+	{
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+		//Workers that were given no draws recorded nothing and are left out
+		std::vector<VkCommandBuffer> secondaries;
+		for (uint32_t i = 0; i < m_secondaryDrawCounts.size(); i++)
+		{
+			if (m_secondaryDrawCounts[i] > 0)
+			{
+				secondaries.push_back(m_frames[m_currentFrame].getSecondaryCommandBuffer(i));
+			}
+		}
+		if (!secondaries.empty())
+		{
+			vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+		}
+	}
+	else
+	{
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		recordDraws(commandBuffer, 0, getRecordCount());
+	}
+
+	vkCmdEndRenderPass(commandBuffer);
+	m_profiler.writeGpuEnd(commandBuffer);
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) 
+	{
+		throw std::runtime_error("failed to record command buffer!");
+	}
+}
+
+//Splits the draws evenly across the workers. Each worker resets its own pool for this frame and records its share
+//into its secondary buffer, inheriting the render pass and framebuffer the primary is about to begin
+void VulkanWrapper::recordSecondaryCommandBuffers(uint32_t imageIndex)
+{
+	uint32_t workerCount = static_cast<uint32_t>(m_secondaryDrawCounts.size());
+	uint32_t recordCount = getRecordCount();
+	FrameContext& frame = m_frames[m_currentFrame];
+
+	m_recordPool.parallelFor(workerCount, [this, workerCount, recordCount, &frame, imageIndex](uint32_t worker) {
+		uint32_t firstDraw = static_cast<uint32_t>(static_cast<uint64_t>(recordCount) * worker / workerCount);
+		uint32_t lastDraw = static_cast<uint32_t>(static_cast<uint64_t>(recordCount) * (worker + 1) / workerCount);
+		m_secondaryDrawCounts[worker] = lastDraw - firstDraw;
 
+		vkResetCommandPool(m_logicalDevice, frame.getWorkerCommandPool(worker), 0);
+		if (lastDraw == firstDraw)
+		{
+			return;
+		}
+
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = m_renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = m_swapChainFramebuffers[imageIndex];
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		VkCommandBuffer commandBuffer = frame.getSecondaryCommandBuffer(worker);
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to begin recording secondary command buffer!");
+		}
+
+		recordDraws(commandBuffer, firstDraw, lastDraw - firstDraw);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to record secondary command buffer!");
+		}
+	});
+}
+
+//Everything a draw needs is set here, secondary command buffers do not inherit pipeline or dynamic state. With instance
+//attributes each draw is one of the frame's instance batches
+void VulkanWrapper::recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount)
+{
 	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)m_swapChainExtent.width;
+	viewport.height = (float)m_swapChainExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = m_swapChainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
 	VkBuffer vertexBuffers[] = { m_vertexBuffer };
 	VkDeviceSize offsets[] = { 0 };
 	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-	vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT16);
-	vkCmdDraw(commandBuffer, static_cast<uint32_t>(m_vertices.size()), 1, 0, 0);
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(m_indices.size()), 1, 0, 0, 0);
-	vkCmdEndRenderPass(commandBuffer);
+	vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, m_indexType);
 
-	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) 
+	VkDescriptorSet uniformSet = m_frames[m_currentFrame].getUniformSet();
+	uint32_t indexCount = m_indexCount;
+	const FrameUniforms& uniforms = m_frameUniforms;
+
+	ObjectUniforms object{};
+	object.model = uniforms.model;
+
+	//The bindless heap is bound once and the shader indexes it, classic sets are rebound whenever the material changes
+	if (m_bindless)
 	{
-		throw std::runtime_error("failed to record command buffer!");
+		VkDescriptorSet heapSet = m_bindlessHeap.getSet();
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 1, 1, &heapSet, 0, nullptr);
+
+		BindlessIndices indices{ m_materialBufferIndex };
+		vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(ObjectUniforms), sizeof(indices), &indices);
 	}
+
+	uint32_t boundMaterial = UINT32_MAX;
+	auto setMaterial = [&](uint32_t material) {
+		object.materialIndex = material;
+		if (!m_bindless && object.materialIndex != boundMaterial)
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 1, 1, &m_materialSets[object.materialIndex], 0, nullptr);
+			boundMaterial = object.materialIndex;
+		}
+	};
+
+	//Every dynamic binding needs an offset on each bind, bindings the path does not read stay at the start of the ring
+	switch (m_settings.transformPath)
+	{
+	case TransformPath::PushConstants:
+	{
+		uint32_t dynamicOffsets[] = { uniforms.frameOffset, 0, 0 };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &uniformSet, 3, dynamicOffsets);
+		for (uint32_t i = 0; i < drawCount; i++)
+		{
+			setMaterial(getDrawMaterial(firstDraw + i));
+			vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ObjectUniforms), &object);
+			vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+		}
+		break;
+	}
+	case TransformPath::DynamicUniform:
+		for (uint32_t i = 0; i < drawCount; i++)
+		{
+			setMaterial(getDrawMaterial(firstDraw + i));
+			uint32_t objectOffset = (firstDraw + i) * uniforms.objectStride;
+			memcpy(uniforms.objectData + objectOffset, &object, sizeof(object));
+
+			uint32_t dynamicOffsets[] = { uniforms.frameOffset, uniforms.objectOffset + objectOffset, 0 };
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &uniformSet, 3, dynamicOffsets);
+			vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+		}
+		break;
+	case TransformPath::StorageBuffer:
+	{
+		//One bind for all draws, the shader picks its element with gl_InstanceIndex, which starts at firstInstance
+		uint32_t dynamicOffsets[] = { uniforms.frameOffset, 0, uniforms.objectOffset };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &uniformSet, 3, dynamicOffsets);
+
+		//GPU-driven draws are one indirect count draw per bucket, the culling pass wrote the commands and the counts
+		if (m_gpuDriven)
+		{
+			const GpuFrame& gpuFrame = m_gpuFrames[m_currentFrame];
+			for (uint32_t i = 0; i < drawCount; i++)
+			{
+				uint32_t bucketIndex = firstDraw + i;
+				const GpuBucket& bucket = m_gpuBuckets[bucketIndex];
+				setMaterial(bucket.material);
+				vkCmdDrawIndexedIndirectCount(commandBuffer, gpuFrame.commandBuffer, bucket.commandBase * sizeof(VkDrawIndexedIndirectCommand),
+					gpuFrame.countBuffer, bucketIndex * sizeof(uint32_t), bucket.capacity, sizeof(VkDrawIndexedIndirectCommand));
+			}
+			break;
+		}
+		for (uint32_t i = 0; i < drawCount; i++)
+		{
+			uint32_t draw = firstDraw + i;
+			setMaterial(getDrawMaterial(draw));
+			memcpy(uniforms.objectData + draw * uniforms.objectStride, &object, sizeof(object));
+			vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, draw);
+		}
+		break;
+	}
+	case TransformPath::InstanceAttributes:
+	{
+		//Materials are per instance with bindless, so only classic sets make the batcher split by material
+		uint32_t dynamicOffsets[] = { uniforms.frameOffset, 0, 0 };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &uniformSet, 3, dynamicOffsets);
+		VkDeviceSize instanceOffset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, 1, 1, &uniforms.instanceBuffer, &instanceOffset);
+		const std::vector<InstanceBatcher::Batch>& batches = m_instanceBatcher.getBatches();
+		for (uint32_t i = 0; i < drawCount; i++)
+		{
+			const InstanceBatcher::Batch& batch = batches[firstDraw + i];
+			const MeshRange& mesh = m_meshRanges[batch.mesh];
+			setMaterial(batch.material);
+			vkCmdDrawIndexed(commandBuffer, mesh.indexCount, batch.instanceCount, mesh.firstIndex, 0, batch.firstInstance);
+		}
+		break;
+	}
+	}
+}
+
+//Draws recordDraws is given in total this frame
+uint32_t VulkanWrapper::getRecordCount() const
+{
+	if (m_settings.transformPath == TransformPath::InstanceAttributes)
+	{
+		return static_cast<uint32_t>(m_instanceBatcher.getBatches().size());
+	}
+	if (m_gpuDriven)
+	{
+		return static_cast<uint32_t>(m_gpuBuckets.size());
+	}
+	return m_settings.drawCount;
 }
 
+void VulkanWrapper::drawInstances(uint32_t mesh, uint32_t material, const InstanceData* instances, uint32_t instanceCount)
+{
+	if (m_settings.transformPath != TransformPath::InstanceAttributes)
+	{
+		throw std::runtime_error("failed to queue instances, the instance attributes path is not in use!");
+	}
+	if (mesh >= m_meshRanges.size() || material >= m_materials.size())
+	{
+		throw std::runtime_error("failed to queue instances, mesh or material out of range!");
+	}
+	m_instanceBatcher.add(mesh, material, instances, instanceCount);
+}
+
+//Writes the per-frame constants into the current frame's uniform ring and, for the descriptor based transform paths,
+//reserves one per-draw slot for every draw in a single allocation, so recording threads can fill their own draws'
+//slots without touching the ring themselves
+void VulkanWrapper::writeFrameUniforms()
+{
+	FrameContext& frame = m_frames[m_currentFrame];
+	uint32_t drawCount = (std::max)(m_settings.drawCount, 1u);
+
+	FrameContext::ScratchAllocation frameAllocation = frame.allocateScratch(sizeof(UniformBufferObject), m_uniformAlignment);
+	FrameContext::ScratchAllocation objectAllocation;
+	uint32_t stride = 0;
+	if (m_settings.transformPath == TransformPath::DynamicUniform)
+	{
+		stride = static_cast<uint32_t>((sizeof(ObjectUniforms) + m_uniformAlignment - 1) / m_uniformAlignment * m_uniformAlignment);
+		objectAllocation = frame.allocateScratch(static_cast<VkDeviceSize>(stride) * drawCount, m_uniformAlignment);
+	}
+	else if (m_settings.transformPath == TransformPath::StorageBuffer)
+	{
+		stride = sizeof(ObjectUniforms);
+		objectAllocation = frame.allocateScratch(static_cast<VkDeviceSize>(stride) * drawCount, m_storageAlignment);
+	}
+
+	float time = m_runStarted ? std::chrono::duration<float>(std::chrono::steady_clock::now() - m_runStart).count() : 0.0f;
+	float aspect = m_swapChainExtent.height > 0 ? m_swapChainExtent.width / (float)m_swapChainExtent.height : 1.0f;
+
+	UniformBufferObject* ubo = static_cast<UniformBufferObject*>(frameAllocation.data);
+	ubo->view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	ubo->proj = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 10.0f);
+	//GLM was written for OpenGL, whose clip space Y points the other way
+	ubo->proj[1][1] *= -1;
+	ubo->texCoordTransform = m_texCoordTransform;
+
+	m_frameUniforms.frameOffset = static_cast<uint32_t>(frameAllocation.offset);
+	m_frameUniforms.objectOffset = static_cast<uint32_t>(objectAllocation.offset);
+	m_frameUniforms.objectStride = stride;
+	m_frameUniforms.objectData = static_cast<char*>(objectAllocation.data);
+	m_frameUniforms.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)) * m_meshTransform;
+
+	m_runStats.drawCalls = m_settings.drawCount;
+	if (m_settings.transformPath == TransformPath::InstanceAttributes)
+	{
+		writeFrameInstances();
+		m_runStats.drawCalls = static_cast<uint32_t>(m_instanceBatcher.getBatches().size());
+	}
+
+	if (m_gpuDriven)
+	{
+		FrameContext::ScratchAllocation cullAllocation = frame.allocateScratch(sizeof(CullUniforms), m_uniformAlignment);
+		CullUniforms* cull = static_cast<CullUniforms*>(cullAllocation.data);
+		cull->sceneModel = m_frameUniforms.model;
+		cull->objectCount = m_gpuObjectCount;
+
+		//Gribb and Hartmann: each plane is the view projection's last row plus or minus one of the others. Near is the
+		//third row alone because clip space depth runs from 0 to 1
+		glm::mat4 viewProj = ubo->proj * ubo->view;
+		glm::vec4 rows[4];
+		for (int row = 0; row < 4; row++)
+		{
+			rows[row] = glm::vec4(viewProj[0][row], viewProj[1][row], viewProj[2][row], viewProj[3][row]);
+		}
+		const glm::vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[2], rows[3] - rows[2] };
+		for (int i = 0; i < 6; i++)
+		{
+			cull->frustumPlanes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+		}
+
+		m_frameUniforms.cullOffset = static_cast<uint32_t>(cullAllocation.offset);
+		m_runStats.drawCalls = static_cast<uint32_t>(m_gpuBuckets.size());
+	}
+}
+
+//Batches everything queued with drawInstances() into the frame's instance buffer, or the drawCount copies of the mesh
+//the other paths draw if nothing was queued. A previous frame may still be reading the old buffer when it grows, so
+//it goes through the deletion queue
+void VulkanWrapper::writeFrameInstances()
+{
+	if (m_instanceBatcher.isEmpty())
+	{
+		for (uint32_t draw = 0; draw < m_settings.drawCount; draw++)
+		{
+			InstanceData instance = packInstance(m_frameUniforms.model, glm::vec4(1.0f), getDrawMaterial(draw));
+			m_instanceBatcher.add(0, instance.materialIndex, &instance, 1);
+		}
+	}
+
+	InstanceStream& stream = m_instanceStreams[m_currentFrame];
+	VkDeviceSize instanceBytes = sizeof(InstanceData) * m_instanceBatcher.getInstanceCount();
+	if (instanceBytes > stream.capacity)
+	{
+		retireBuffer(stream.buffer, stream.memory);
+		stream.capacity = (std::max)(instanceBytes, stream.capacity * 2);
+		createBuffer(stream.capacity, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stream.buffer, stream.memory);
+	}
+
+	m_instanceBatcher.build(static_cast<InstanceData*>(stream.memory.mappedData));
+	m_frameUniforms.instanceBuffer = stream.buffer;
+}
+
+void VulkanWrapper::createRecordingThreads()
+{
+	uint32_t workerCount = m_settings.recordThreads;
+	if (workerCount == 0)
+	{
+		return;
+	}
+
+	m_recordPool.start(workerCount);
+	m_secondaryDrawCounts.assign(workerCount, 0);
+
+	std::cout << "Recording draws on " << workerCount << " worker threads" << std::endl;
+}
+
+void VulkanWrapper::destroyRecordingThreads()
+{
+	m_recordPool.stop();
+	m_secondaryDrawCounts.clear();
+}
 
 void VulkanWrapper::createSyncObjects()
 {
-	m_imageAvailableSemaphores.resize(m_maxFramesInFlight);
-	m_renderFinishedSemaphores.resize(m_maxFramesInFlight);
-	m_inFlightFences.resize(m_maxFramesInFlight);
+	m_imageAvailableSemaphores.resize(m_framesInFlight);
+	m_renderFinishedSemaphores.resize(m_framesInFlight);
+	m_frameValues.assign(m_framesInFlight, 0);
 
 	VkSemaphoreCreateInfo semaphoreInfo{};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	VkFenceCreateInfo fenceInfo{};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-	for (size_t i = 0; i < m_maxFramesInFlight; i++) {
+	for (size_t i = 0; i < m_framesInFlight; i++) {
 		if (vkCreateSemaphore(m_logicalDevice, &semaphoreInfo, nullptr, &m_imageAvailableSemaphores[i]) != VK_SUCCESS ||
-			vkCreateSemaphore(m_logicalDevice, &semaphoreInfo, nullptr, &m_renderFinishedSemaphores[i]) != VK_SUCCESS ||
-			vkCreateFence(m_logicalDevice, &fenceInfo, nullptr, &m_inFlightFences[i]) != VK_SUCCESS) {
+			vkCreateSemaphore(m_logicalDevice, &semaphoreInfo, nullptr, &m_renderFinishedSemaphores[i]) != VK_SUCCESS) {
 
 			throw std::runtime_error("failed to create synchronization objects for a frame!");
 		}
 	}
+
+	//Slot values start at 0, which the timeline has already reached, so the first wait on each slot returns at once
+	m_frameTimeline.init(m_logicalDevice);
+	m_deletionQueue.init(m_logicalDevice, m_allocator, m_frameTimeline);
+	m_pacer.init(m_settings.targetLatencyMs);
 }
 
 
+//Only the objects that depend on the swapchain images are rebuilt here. The pipeline uses dynamic viewport/scissor state
+//so it and the render pass survive a resize, unless the surface format itself changed.
+//Frames still in flight may use the old objects, so they go through the deletion queue instead of idling the device
 void VulkanWrapper::recreateSwapchain()
 {
 	int width = 0, height = 0;
@@ -1016,55 +1946,97 @@ void VulkanWrapper::recreateSwapchain()
 		glfwGetFramebufferSize(m_window, &width, &height);
 		glfwWaitEvents();
 	}
-	vkDeviceWaitIdle(m_logicalDevice);
+
+	retireSwapchainViews();
+
+	VkSwapchainKHR oldSwapchain = m_swapchain;
+	VkFormat oldFormat = m_swapChainImageFormat;
 
 	createSwapChain();
+	m_deletionQueue.destroySwapchain(oldSwapchain);
+
 	createImageViews();
-	createRenderPass();
-	createGraphicsPipeline();
+
+	if (m_swapChainImageFormat != oldFormat)
+	{
+		m_deletionQueue.destroyPipeline(m_graphicsPipeline);
+		m_deletionQueue.destroyPipelineLayout(m_pipelineLayout);
+		m_deletionQueue.destroyRenderPass(m_renderPass);
+
+		createRenderPass();
+		createGraphicsPipeline();
+	}
+
 	createFrameBuffers();
 }
 
-void VulkanWrapper::cleanUpSwapchain()
+void VulkanWrapper::cleanUpSwapchainViews()
 {
 	for (size_t i = 0; i < m_swapChainFramebuffers.size(); i++) {
 		vkDestroyFramebuffer(m_logicalDevice, m_swapChainFramebuffers[i], nullptr);
 	}
-
-	vkDestroyPipeline(m_logicalDevice, m_graphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(m_logicalDevice, m_pipelineLayout, nullptr);
-	vkDestroyRenderPass(m_logicalDevice, m_renderPass, nullptr);
+	m_swapChainFramebuffers.clear();
 
 	for (size_t i = 0; i < m_swapChainImageViews.size(); i++) {
 		vkDestroyImageView(m_logicalDevice, m_swapChainImageViews[i], nullptr);
 	}
-
-	vkDestroySwapchainKHR(m_logicalDevice, m_swapchain, nullptr);
+	m_swapChainImageViews.clear();
 }
 
+void VulkanWrapper::retireSwapchainViews()
+{
+	for (VkFramebuffer framebuffer : m_swapChainFramebuffers) {
+		m_deletionQueue.destroyFramebuffer(framebuffer);
+	}
+	m_swapChainFramebuffers.clear();
 
-uint32_t VulkanWrapper::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+	for (VkImageView imageView : m_swapChainImageViews) {
+		m_deletionQueue.destroyImageView(imageView);
+	}
+	m_swapChainImageViews.clear();
+}
+
+void VulkanWrapper::cleanUpSwapchain()
 {
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memProperties);
+	cleanUpSwapchainViews();
 
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) 
+	if (m_settings.headless)
 	{
-		if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-			return i;
+		for (size_t i = 0; i < m_swapChainImages.size(); i++) {
+			destroyImage(m_swapChainImages[i], m_offscreenImageMemory[i]);
 		}
+		m_swapChainImages.clear();
+		m_offscreenImageMemory.clear();
+		return;
 	}
 
-	throw std::runtime_error("failed to find suitable memory type!");
+	vkDestroySwapchainKHR(m_logicalDevice, m_swapchain, nullptr);
+	m_swapchain = VK_NULL_HANDLE;
+	m_swapChainImages.clear();
 }
 
-void VulkanWrapper::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+
+uint32_t VulkanWrapper::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+	return m_allocator.findMemoryType(typeFilter, properties);
+}
+
+//Memory comes from the sub-allocator, so the buffer is bound at its offset inside a shared block rather than at 0
+void VulkanWrapper::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, MemoryAllocation& bufferMemory) {
 	VkBufferCreateInfo bufferInfo{};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferInfo.size = size;
 	bufferInfo.usage = usage;
 	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+	//Buffers written on the transfer queue are shared with graphics rather than moved across with ownership barriers
+	uint32_t queueFamilyIndices[] = { m_queueFamilies.graphicsFamily.value(), m_queueFamilies.transferFamily.value() };
+	if ((usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) && queueFamilyIndices[0] != queueFamilyIndices[1]) {
+		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount = 2;
+		bufferInfo.pQueueFamilyIndices = queueFamilyIndices;
+	}
+
 	if (vkCreateBuffer(m_logicalDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create buffer!");
 	}
@@ -1072,74 +2044,563 @@ void VulkanWrapper::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, Vk
 	VkMemoryRequirements memRequirements;
 	vkGetBufferMemoryRequirements(m_logicalDevice, buffer, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+	bufferMemory = m_allocator.allocate(memRequirements, properties, true);
 
-	if (vkAllocateMemory(m_logicalDevice, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate buffer memory!");
+	vkBindBufferMemory(m_logicalDevice, buffer, bufferMemory.memory, bufferMemory.offset);
+}
+
+void VulkanWrapper::destroyBuffer(VkBuffer& buffer, MemoryAllocation& bufferMemory)
+{
+	vkDestroyBuffer(m_logicalDevice, buffer, nullptr);
+	m_allocator.free(bufferMemory);
+	buffer = VK_NULL_HANDLE;
+}
+
+void VulkanWrapper::retireBuffer(VkBuffer& buffer, MemoryAllocation& bufferMemory)
+{
+	m_deletionQueue.destroyBuffer(buffer, bufferMemory);
+	buffer = VK_NULL_HANDLE;
+	bufferMemory = MemoryAllocation{};
+}
+
+void VulkanWrapper::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory)
+{
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = width;
+	imageInfo.extent.height = height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = format;
+	imageInfo.tiling = tiling;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = usage;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	uint32_t queueFamilyIndices[] = { m_queueFamilies.graphicsFamily.value(), m_queueFamilies.transferFamily.value() };
+	if ((usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) && queueFamilyIndices[0] != queueFamilyIndices[1]) {
+		imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		imageInfo.queueFamilyIndexCount = 2;
+		imageInfo.pQueueFamilyIndices = queueFamilyIndices;
+	}
+
+	if (vkCreateImage(m_logicalDevice, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create image!");
 	}
 
-	vkBindBufferMemory(m_logicalDevice, buffer, bufferMemory, 0);
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(m_logicalDevice, image, &memRequirements);
+
+	imageMemory = m_allocator.allocate(memRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR);
+
+	vkBindImageMemory(m_logicalDevice, image, imageMemory.memory, imageMemory.offset);
+}
+
+void VulkanWrapper::destroyImage(VkImage& image, MemoryAllocation& imageMemory)
+{
+	vkDestroyImage(m_logicalDevice, image, nullptr);
+	m_allocator.free(imageMemory);
+	image = VK_NULL_HANDLE;
 }
 
+//Binding 0 holds the per-frame UniformBufferObject, binding 1 one draw's ObjectUniforms and binding 2 every draw's
+//ObjectUniforms as a storage buffer array. All three are dynamic so one set per frame in flight covers every draw,
+//only the offsets passed to vkCmdBindDescriptorSets change
 void VulkanWrapper::createDescriptorSetLayout()
 {
-	VkDescriptorSetLayoutBinding uboLayoutBinding{};
-	uboLayoutBinding.binding = 0;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	uboLayoutBinding.descriptorCount = 1;
-	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	uboLayoutBinding.pImmutableSamplers = nullptr;
+	const VkDescriptorType types[] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC };
+
+	VkDescriptorSetLayoutBinding uboLayoutBindings[3]{};
+	for (uint32_t i = 0; i < 3; i++) {
+		uboLayoutBindings[i].binding = i;
+		uboLayoutBindings[i].descriptorType = types[i];
+		uboLayoutBindings[i].descriptorCount = 1;
+		uboLayoutBindings[i].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		uboLayoutBindings[i].pImmutableSamplers = nullptr;
+	}
 
 	VkDescriptorSetLayoutCreateInfo layoutInfo{};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfo.bindingCount = 1;
-	layoutInfo.pBindings = &uboLayoutBinding;
+	layoutInfo.bindingCount = 3;
+	layoutInfo.pBindings = uboLayoutBindings;
+
+	m_descriptorSetLayout = m_descriptorLayoutCache.createLayout(layoutInfo);
+}
 
-	if (vkCreateDescriptorSetLayout(m_logicalDevice, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create descriptor set layout!");
+//Set 1 holds the materials: the bindless heap, or in classic mode a single material's uniform buffer and texture
+void VulkanWrapper::createMaterialSetLayout()
+{
+	if (m_bindless)
+	{
+		m_bindlessHeap.init(m_logicalDevice, m_descriptorLayoutCache, m_frameTimeline, s_maxBindlessTextures, s_maxBindlessBuffers);
+		m_materialSetLayout = m_bindlessHeap.getLayout();
+		return;
 	}
+
+	VkDescriptorSetLayoutBinding materialBindings[2]{};
+	materialBindings[0].binding = 0;
+	materialBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	materialBindings[0].descriptorCount = 1;
+	materialBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	materialBindings[1].binding = 1;
+	materialBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	materialBindings[1].descriptorCount = 1;
+	materialBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = materialBindings;
+
+	m_materialSetLayout = m_descriptorLayoutCache.createLayout(layoutInfo);
 }
 
-void VulkanWrapper::cleanUp()
+//Material 0 is untextured (the white default texture), then one white material per loaded texture. Classic sets bind
+//each entry at its own offset, so entries are spaced to the uniform buffer offset alignment there; the bindless
+//storage buffer packs them
+void VulkanWrapper::createMaterials()
 {
-	cleanUpSwapchain();
-	vkDestroyDescriptorSetLayout(m_logicalDevice, descriptorSetLayout, nullptr);
-	vkDestroyBuffer(m_logicalDevice, m_vertexBuffer, nullptr);
-	vkDestroyBuffer(m_logicalDevice, m_indexBuffer, nullptr);
-	vkFreeMemory(m_logicalDevice, m_indexBufferMemory, nullptr);
+	m_materialTextures.assign(1, 0);
+	m_materialTextures.insert(m_materialTextures.end(), m_loadedTextures.begin(), m_loadedTextures.end());
+
+	//Bindless materials refer to their texture by heap index
+	std::vector<uint32_t> heapIndices;
+	for (uint32_t texture = 0; m_bindless && texture < m_textures.getTextureCount(); texture++)
+	{
+		const TextureManager::Texture& entry = m_textures.getTexture(texture);
+		heapIndices.push_back(m_bindlessHeap.addTexture(entry.view, entry.sampler));
+	}
+
+	m_materials.clear();
+	for (uint32_t texture : m_materialTextures)
+	{
+		MaterialData material{};
+		material.baseColor = glm::vec4(1.0f);
+		material.textureIndex = m_bindless ? heapIndices[texture] : BindlessHeap::s_invalidIndex;
+		m_materials.push_back(material);
+	}
+
+	VkDeviceSize alignment = m_bindless ? 1 : m_uniformAlignment;
+	m_materialStride = (sizeof(MaterialData) + alignment - 1) / alignment * alignment;
+
+	VkDeviceSize bufferSize = m_materialStride * m_materials.size();
+	std::vector<char> data(static_cast<size_t>(bufferSize), 0);
+	for (size_t i = 0; i < m_materials.size(); i++)
+	{
+		memcpy(data.data() + i * m_materialStride, &m_materials[i], sizeof(MaterialData));
+	}
 
-	vkDestroyBuffer(m_logicalDevice, m_vertexBuffer, nullptr);
-	vkFreeMemory(m_logicalDevice, m_vertexBufferMemory, nullptr);
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_materialBuffer, m_materialBufferMemory);
+	m_uploadManager.uploadBuffer(m_materialBuffer, 0, data.data(), bufferSize);
 
-	for (size_t i = 0; i < m_maxFramesInFlight; i++) 
+	if (m_bindless)
 	{
-		vkDestroySemaphore(m_logicalDevice, m_renderFinishedSemaphores[i], nullptr);
-		vkDestroySemaphore(m_logicalDevice, m_imageAvailableSemaphores[i], nullptr);
-		vkDestroyFence(m_logicalDevice, m_inFlightFences[i], nullptr);
+		m_materialBufferIndex = m_bindlessHeap.addBuffer(m_materialBuffer, 0, bufferSize);
+		return;
 	}
-	vkDestroyCommandPool(m_logicalDevice, m_commandPool, nullptr);
-	for (auto framebuffer : m_swapChainFramebuffers)
+
+	m_materialSets.clear();
+	for (size_t i = 0; i < m_materials.size(); i++)
 	{
-		vkDestroyFramebuffer(m_logicalDevice, framebuffer, nullptr);
+		const TextureManager::Texture& texture = m_textures.getTexture(m_materialTextures[i]);
+		DescriptorSetCache::Binding bindings[] = {
+			DescriptorSetCache::bufferBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, m_materialBuffer, i * m_materialStride, sizeof(MaterialData)),
+			DescriptorSetCache::imageBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, texture.sampler, texture.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+		};
+		m_materialSets.push_back(m_descriptorSetCache.get(m_materialSetLayout, bindings, 2));
 	}
-	vkDestroyPipeline(m_logicalDevice, m_graphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(m_logicalDevice, m_pipelineLayout, nullptr);
-	vkDestroyRenderPass(m_logicalDevice, m_renderPass, nullptr);
-	for (auto imageView : m_swapChainImageViews)
+}
+
+//Draws cycle through the textured materials, material 0 is only used when no textures were loaded
+uint32_t VulkanWrapper::getDrawMaterial(uint32_t draw) const
+{
+	uint32_t textured = static_cast<uint32_t>(m_materials.size()) - 1;
+	return textured > 0 ? 1 + draw % textured : 0;
+}
+
+//Starts with the default texture, then everything in Settings::texturePaths. The textures go in a batch of their own
+//so the upload bandwidth reported covers their copies alone, timed by drawFrame() polling it rather than waiting on it
+void VulkanWrapper::createTexureImage()
+{
+	std::vector<uint32_t> queueFamilies = { m_queueFamilies.graphicsFamily.value() };
+	if (m_queueFamilies.transferFamily.value() != queueFamilies[0])
 	{
-		vkDestroyImageView(m_logicalDevice, imageView, nullptr);
+		queueFamilies.push_back(m_queueFamilies.transferFamily.value());
 	}
-	if (enableValidationLayers)
+	m_textures.init(m_logicalDevice, m_physicalDevice, m_allocator, m_uploadManager, queueFamilies, m_maxAnisotropy);
+
+	const uint32_t white = 0xFFFFFFFF;
+	if (m_uploadManager.hasPendingWork())
+	{
+		m_uploadManager.flush();
+	}
+	m_textures.create(1, 1, &white, false);
+	m_loadedTextures = m_textures.load(m_settings.texturePaths);
+	m_uploadManager.flush();
+	m_textures.startUploadTimer();
+}
+
+bool VulkanWrapper::supportsBindless(VkPhysicalDevice device)
+{
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 features{};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &features12;
+	vkGetPhysicalDeviceFeatures2(device, &features);
+
+	bool supported = features12.descriptorIndexing && features12.runtimeDescriptorArray && features12.descriptorBindingPartiallyBound &&
+		features12.descriptorBindingUpdateUnusedWhilePending && features12.descriptorBindingSampledImageUpdateAfterBind &&
+		features12.descriptorBindingStorageBufferUpdateAfterBind && features12.shaderSampledImageArrayNonUniformIndexing &&
+		features.features.shaderStorageBufferArrayDynamicIndexing;
+	if (!supported)
+	{
+		return false;
+	}
+
+	//The heap's arrays are sized up front, combined image samplers count as both a sampler and a sampled image, and
+	//both arrays are visible to the vertex and fragment stages
+	VkPhysicalDeviceVulkan12Properties properties12{};
+	properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &properties12;
+	vkGetPhysicalDeviceProperties2(device, &properties);
+
+	return properties12.maxPerStageDescriptorUpdateAfterBindSamplers >= s_maxBindlessTextures &&
+		properties12.maxPerStageDescriptorUpdateAfterBindSampledImages >= s_maxBindlessTextures &&
+		properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers >= s_maxBindlessBuffers &&
+		properties12.maxDescriptorSetUpdateAfterBindSamplers >= s_maxBindlessTextures &&
+		properties12.maxDescriptorSetUpdateAfterBindSampledImages >= s_maxBindlessTextures &&
+		properties12.maxDescriptorSetUpdateAfterBindStorageBuffers >= s_maxBindlessBuffers &&
+		properties12.maxPerStageUpdateAfterBindResources >= s_maxBindlessTextures + s_maxBindlessBuffers;
+}
+
+//Indirect commands start at the object's index, and each bucket is a single call covering many of them
+bool VulkanWrapper::supportsGpuDriven(VkPhysicalDevice device)
+{
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 features{};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &features12;
+	vkGetPhysicalDeviceFeatures2(device, &features);
+
+	return features12.drawIndirectCount && features.features.multiDrawIndirect && features.features.drawIndirectFirstInstance;
+}
+
+//The bindings of cull.comp. CullUniforms and the ObjectData output live in the frame's uniform ring, so both are dynamic
+void VulkanWrapper::createCullSetLayout()
+{
+	if (!m_gpuDriven)
+	{
+		return;
+	}
+
+	const VkDescriptorType types[] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+
+	VkDescriptorSetLayoutBinding cullBindings[6]{};
+	for (uint32_t i = 0; i < 6; i++)
+	{
+		cullBindings[i].binding = i;
+		cullBindings[i].descriptorType = types[i];
+		cullBindings[i].descriptorCount = 1;
+		cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 6;
+	layoutInfo.pBindings = cullBindings;
+
+	m_cullSetLayout = m_descriptorLayoutCache.createLayout(layoutInfo);
+}
+
+void VulkanWrapper::createCullPipeline()
+{
+	VkShaderModule cullShaderModule = m_shaders.createModule(m_logicalDevice, "shaders/cull.spv");
+
+	VkPipelineShaderStageCreateInfo cullShaderStageInfo{};
+	cullShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	cullShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullShaderStageInfo.module = cullShaderModule;
+	cullShaderStageInfo.pName = "main";
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_cullSetLayout;
+
+	if (vkCreatePipelineLayout(m_logicalDevice, &pipelineLayoutInfo, nullptr, &m_cullPipelineLayout) != VK_SUCCESS)
+	{
+		vkDestroyShaderModule(m_logicalDevice, cullShaderModule, nullptr);
+		throw std::runtime_error("failed to create culling pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = cullShaderStageInfo;
+	pipelineInfo.layout = m_cullPipelineLayout;
+
+	VkResult result = vkCreateComputePipelines(m_logicalDevice, m_pipelineCache.getHandle(), 1, &pipelineInfo, nullptr, &m_cullPipeline);
+	vkDestroyShaderModule(m_logicalDevice, cullShaderModule, nullptr);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create culling pipeline!");
+	}
+}
+
+//The drawCount copies of mesh 0 the CPU paths draw, as GPU objects bucketed by material. Objects keep an identity
+//model, the frame's scene transform is applied by the culling pass. Static data goes into the current upload batch
+void VulkanWrapper::createGpuScene()
+{
+	if (!m_gpuDriven)
+	{
+		return;
+	}
+
+	m_gpuObjectCount = m_settings.drawCount;
+
+	std::vector<GpuMesh> meshes;
+	for (const MeshRange& range : m_meshRanges)
+	{
+		GpuMesh mesh{};
+		glm::vec3 center = (range.bounds.min + range.bounds.max) * 0.5f;
+		mesh.boundingSphere = glm::vec4(center, glm::length(range.bounds.max - range.bounds.min) * 0.5f);
+		mesh.firstIndex = range.firstIndex;
+		mesh.indexCount = range.indexCount;
+		meshes.push_back(mesh);
+	}
+
+	//Classic sets need a bind per material, so each material gets its own range of commands and its own counter.
+	//Bindless reads the material per object and puts everything in one bucket
+	uint32_t materialBuckets = m_bindless ? 1 : static_cast<uint32_t>(m_materials.size());
+	std::vector<uint32_t> bucketSizes(materialBuckets, 0);
+	for (uint32_t object = 0; object < m_gpuObjectCount; object++)
+	{
+		bucketSizes[m_bindless ? 0 : getDrawMaterial(object)]++;
+	}
+
+	std::vector<uint32_t> bucketIndices(materialBuckets, UINT32_MAX);
+	uint32_t commandBase = 0;
+	m_gpuBuckets.clear();
+	for (uint32_t material = 0; material < materialBuckets; material++)
+	{
+		if (bucketSizes[material] == 0)
+		{
+			continue;
+		}
+		bucketIndices[material] = static_cast<uint32_t>(m_gpuBuckets.size());
+		m_gpuBuckets.push_back(GpuBucket{ material, commandBase, bucketSizes[material] });
+		commandBase += bucketSizes[material];
+	}
+
+	std::vector<GpuObject> objects(m_gpuObjectCount);
+	for (uint32_t object = 0; object < m_gpuObjectCount; object++)
+	{
+		GpuObject& gpuObject = objects[object];
+		gpuObject.model = glm::mat4(1.0f);
+		gpuObject.materialIndex = getDrawMaterial(object);
+		gpuObject.mesh = 0;
+		gpuObject.bucket = bucketIndices[m_bindless ? 0 : gpuObject.materialIndex];
+		gpuObject.commandBase = m_gpuBuckets[gpuObject.bucket].commandBase;
+	}
+
+	//Buffers cannot be empty, a scene without objects still gets one element of each
+	uint32_t objectSlots = (std::max)(m_gpuObjectCount, 1u);
+	VkDeviceSize objectBytes = sizeof(GpuObject) * objectSlots;
+	createBuffer(objectBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_gpuObjectBuffer, m_gpuObjectMemory);
+	if (!objects.empty())
+	{
+		m_uploadManager.uploadBuffer(m_gpuObjectBuffer, 0, objects.data(), sizeof(GpuObject) * objects.size());
+	}
+
+	VkDeviceSize meshBytes = sizeof(GpuMesh) * meshes.size();
+	createBuffer(meshBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_gpuMeshBuffer, m_gpuMeshMemory);
+	m_uploadManager.uploadBuffer(m_gpuMeshBuffer, 0, meshes.data(), meshBytes);
+
+	VkDeviceSize commandBytes = sizeof(VkDrawIndexedIndirectCommand) * objectSlots;
+	VkDeviceSize countBytes = sizeof(uint32_t) * (std::max)(m_gpuBuckets.size(), size_t(1));
+	m_gpuFrames.resize(m_framesInFlight);
+	for (uint32_t i = 0; i < m_framesInFlight; i++)
+	{
+		GpuFrame& gpuFrame = m_gpuFrames[i];
+		createBuffer(commandBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			gpuFrame.commandBuffer, gpuFrame.commandMemory);
+		createBuffer(countBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, gpuFrame.countBuffer, gpuFrame.countMemory);
+
+		VkBuffer scratchBuffer = m_frames[i].getScratchBuffer();
+		DescriptorSetCache::Binding bindings[] = {
+			DescriptorSetCache::bufferBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, scratchBuffer, 0, sizeof(CullUniforms)),
+			DescriptorSetCache::bufferBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_gpuObjectBuffer, 0, objectBytes),
+			DescriptorSetCache::bufferBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_gpuMeshBuffer, 0, meshBytes),
+			DescriptorSetCache::bufferBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, scratchBuffer, 0, sizeof(ObjectUniforms) * objectSlots),
+			DescriptorSetCache::bufferBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, gpuFrame.commandBuffer, 0, commandBytes),
+			DescriptorSetCache::bufferBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, gpuFrame.countBuffer, 0, countBytes),
+		};
+		gpuFrame.cullSet = m_descriptorSetCache.get(m_cullSetLayout, bindings, 6);
+	}
+
+	std::cout << "GPU-driven: " << m_gpuObjectCount << " objects culled on the GPU, " << m_gpuBuckets.size() << " indirect count draws per frame" << std::endl;
+}
+
+//The sets belong to the descriptor set cache and go with it
+void VulkanWrapper::destroyGpuScene()
+{
+	for (GpuFrame& gpuFrame : m_gpuFrames)
+	{
+		destroyBuffer(gpuFrame.commandBuffer, gpuFrame.commandMemory);
+		destroyBuffer(gpuFrame.countBuffer, gpuFrame.countMemory);
+	}
+	m_gpuFrames.clear();
+	m_gpuBuckets.clear();
+	destroyBuffer(m_gpuObjectBuffer, m_gpuObjectMemory);
+	destroyBuffer(m_gpuMeshBuffer, m_gpuMeshMemory);
+
+	vkDestroyPipeline(m_logicalDevice, m_cullPipeline, nullptr);
+	vkDestroyPipelineLayout(m_logicalDevice, m_cullPipelineLayout, nullptr);
+	m_cullPipeline = VK_NULL_HANDLE;
+	m_cullPipelineLayout = VK_NULL_HANDLE;
+	m_cullSetLayout = VK_NULL_HANDLE;
+}
+
+//Clears the counters, culls every object and makes the commands, counts and ObjectData visible to the draws. Recorded
+//into the frame's primary command buffer on the graphics queue, ahead of the render pass
+void VulkanWrapper::recordCulling(VkCommandBuffer commandBuffer)
+{
+	if (m_gpuObjectCount == 0)
+	{
+		return;
+	}
+
+	const GpuFrame& gpuFrame = m_gpuFrames[m_currentFrame];
+	vkCmdFillBuffer(commandBuffer, gpuFrame.countBuffer, 0, VK_WHOLE_SIZE, 0);
+
+	VkMemoryBarrier clearBarrier{};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+	uint32_t dynamicOffsets[] = { m_frameUniforms.cullOffset, m_frameUniforms.objectOffset };
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipelineLayout, 0, 1, &gpuFrame.cullSet, 2, dynamicOffsets);
+	vkCmdDispatch(commandBuffer, (m_gpuObjectCount + 63) / 64, 1, 1);
+
+	VkMemoryBarrier cullBarrier{};
+	cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+		1, &cullBarrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanWrapper::createDescriptorCaches()
+{
+	m_descriptorLayoutCache.init(m_logicalDevice);
+	m_descriptorAllocator.init(m_logicalDevice, 16, {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 2.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f },
+	});
+	m_descriptorSetCache.init(m_logicalDevice, m_descriptorAllocator, m_descriptorLayoutCache);
+}
+
+//Sets and layouts go with their pools and the cache, nothing is destroyed one by one
+void VulkanWrapper::destroyDescriptorCaches()
+{
+	m_bindlessHeap.destroy();
+	m_materialSets.clear();
+	m_materialSetLayout = VK_NULL_HANDLE;
+	m_descriptorSetCache.clear();
+	m_descriptorAllocator.destroy();
+	m_descriptorLayoutCache.destroy();
+	m_descriptorSetLayout = VK_NULL_HANDLE;
+}
+
+//Every handle is checked and cleared, so this copes with a partially initialised wrapper and a second call does nothing
+void VulkanWrapper::cleanUp()
+{
+	if (m_logicalDevice != VK_NULL_HANDLE)
+	{
+		//shutdown() has idled the device, so everything still waiting on the timeline can go now
+		m_deletionQueue.destroy();
+		cleanUpSwapchain();
+
+		vkDestroyPipeline(m_logicalDevice, m_graphicsPipeline, nullptr);
+		vkDestroyPipelineLayout(m_logicalDevice, m_pipelineLayout, nullptr);
+		vkDestroyRenderPass(m_logicalDevice, m_renderPass, nullptr);
+		m_graphicsPipeline = VK_NULL_HANDLE;
+		m_pipelineLayout = VK_NULL_HANDLE;
+		m_renderPass = VK_NULL_HANDLE;
+
+		destroyGpuScene();
+		destroyBuffer(m_indexBuffer, m_indexBufferMemory);
+		destroyBuffer(m_materialBuffer, m_materialBufferMemory);
+		m_textures.destroy();
+		destroyBuffer(m_vertexBuffer, m_vertexBufferMemory);
+
+		for (size_t i = 0; i < m_imageAvailableSemaphores.size(); i++) 
+		{
+			vkDestroySemaphore(m_logicalDevice, m_renderFinishedSemaphores[i], nullptr);
+			vkDestroySemaphore(m_logicalDevice, m_imageAvailableSemaphores[i], nullptr);
+		}
+		m_renderFinishedSemaphores.clear();
+		m_imageAvailableSemaphores.clear();
+		m_frameTimeline.destroy();
+		m_frameValues.clear();
+
+		destroyRecordingThreads();
+		destroyFrameContexts();
+		destroyDescriptorCaches();
+
+		m_uploadManager.destroy();
+		m_profiler.destroy();
+		m_pipelineCache.save();
+		m_pipelineCache.destroy();
+		m_shaders.clear();
+
+		m_allocator.printStats();
+		m_runStats.peakGpuMemory = m_allocator.getStats().peakBytesReserved;
+		m_allocator.destroy();
+
+		vkDestroyDevice(m_logicalDevice, nullptr);
+		m_logicalDevice = VK_NULL_HANDLE;
+	}
+
+	if (enableValidationLayers && m_debugMessenger != VK_NULL_HANDLE)
 	{
 		VulkanDebug::DestroyDebugUtilsMessengerEXT(m_vkInstance, m_debugMessenger, nullptr);
-	}	
+		m_debugMessenger = VK_NULL_HANDLE;
+	}
 
-	glfwDestroyWindow(m_window);
-	vkDestroySurfaceKHR(m_vkInstance, m_surface, nullptr);
-	vkDestroyInstance(m_vkInstance, nullptr);
+	if (m_window)
+	{
+		glfwDestroyWindow(m_window);
+		m_window = nullptr;
+	}
+	if (m_surface != VK_NULL_HANDLE)
+	{
+		vkDestroySurfaceKHR(m_vkInstance, m_surface, nullptr);
+		m_surface = VK_NULL_HANDLE;
+	}
+	if (m_vkInstance != VK_NULL_HANDLE)
+	{
+		vkDestroyInstance(m_vkInstance, nullptr);
+		m_vkInstance = VK_NULL_HANDLE;
+	}
 
-	glfwTerminate();
-}
\ No newline at end of file
+	if (m_glfwInitialised)
+	{
+		glfwTerminate();
+		m_glfwInitialised = false;
+	}
+}
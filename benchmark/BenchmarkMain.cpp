@@ -0,0 +1,543 @@
+//Benchmark entry point, built as its own executable from this file plus every .cpp in the root except main.cpp.
+//Runs the renderer once per combination of draw count, recording thread count, transform path, present mode and frame pacing setting for a fixed
+//number of frames and writes one JSON object per run, so CI can compare results against a baseline on a software ICD such as lavapipe.
+//
+//	VulkanBenchmark [--frames N] [--draws 1,100,1000] [--present-modes fifo,mailbox,immediate] [--record-threads 0,1,2,4]
+//	                [--frames-in-flight 1,2,3] [--image-counts 2,3,4] [--target-latency 0,10,20] [--transform-paths push,ubo,ssbo,instanced]
+//	                [--bindless off,on] [--gpu-driven off,on] [--textures a.png,b.png] [--mesh model.obj]
+//	                [--vertex-formats float,packed] [--no-mesh-optimize] [--reduce-overdraw]
+//	                [--width W] [--height H] [--windowed] [--no-pipeline-cache] [--output results.json]
+//
+//Runs are headless unless --windowed is given, present modes only apply to windowed runs. Image counts size the swapchain,
+//or the offscreen ring when headless, 0 keeps the default. Latency and pacing percentiles show what each setting costs in fps.
+//Transform paths compare per-draw push constants against dynamic uniform offsets and a storage buffer, record time at
+//--draws 10000 --transform-paths push,ubo,ssbo is where the difference shows. "instanced" groups the draws into one instanced
+//call per material through a per-instance vertex binding, "draw_calls" is what each frame recorded. --gpu-driven on culls on
+//the GPU and issues indirect count draws instead, through the ssbo path whatever was asked for. "transform_path", "bindless"
+//and "gpu_driven" in the results are what actually ran, a device without descriptor indexing falls back to classic sets.
+//Textures are loaded by every run, the draws cycle through them and "texture_upload_mib_s" is the staging bandwidth their
+//top levels reached: the bytes over the time spent writing them into the staging ring plus their own upload batch's time on
+//the GPU, as first seen complete by a frame (so it can read low on tiny textures), and 0 if no frame saw it finish.
+//
+//	VulkanBenchmark --mesh-load model.obj [--mesh-triangles N] [--no-mesh-optimize] [--reduce-overdraw] [--output results.json]
+//
+//Measures mesh loading instead of rendering: parsing the OBJ text against mapping its baked .mesh files, full
+//precision and packed, and copying the streams out. Also reports the bake's optimisation time and the simulated
+//post-transform cache ACMR/ATVR before and after it. --mesh-triangles first writes a generated grid of at least N triangles to the given path.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <stdexcept>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include "../vulkanWrapper.h"
+#include "../MeshBaker.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+struct PresentModeName
+{
+	const char* name;
+	VkPresentModeKHR mode;
+};
+
+static const PresentModeName s_presentModes[] = {
+	{ "fifo", VK_PRESENT_MODE_FIFO_KHR },
+	{ "fifo_relaxed", VK_PRESENT_MODE_FIFO_RELAXED_KHR },
+	{ "mailbox", VK_PRESENT_MODE_MAILBOX_KHR },
+	{ "immediate", VK_PRESENT_MODE_IMMEDIATE_KHR },
+};
+
+struct TransformPathName
+{
+	const char* name;
+	VulkanWrapper::TransformPath path;
+};
+
+static const TransformPathName s_transformPaths[] = {
+	{ "push", VulkanWrapper::TransformPath::PushConstants },
+	{ "ubo", VulkanWrapper::TransformPath::DynamicUniform },
+	{ "ssbo", VulkanWrapper::TransformPath::StorageBuffer },
+	{ "instanced", VulkanWrapper::TransformPath::InstanceAttributes },
+};
+
+static std::vector<std::string> split(const std::string& list)
+{
+	std::vector<std::string> items;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ','))
+	{
+		if (!item.empty())
+		{
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+static VkPresentModeKHR parsePresentMode(const std::string& name)
+{
+	for (const auto& presentMode : s_presentModes)
+	{
+		if (name == presentMode.name)
+		{
+			return presentMode.mode;
+		}
+	}
+	throw std::runtime_error("unknown present mode " + name + "!");
+}
+
+static VulkanWrapper::TransformPath parseTransformPath(const std::string& name)
+{
+	for (const auto& transformPath : s_transformPaths)
+	{
+		if (name == transformPath.name)
+		{
+			return transformPath.path;
+		}
+	}
+	throw std::runtime_error("unknown transform path " + name + "!");
+}
+
+static const char* getTransformPathName(VulkanWrapper::TransformPath path)
+{
+	for (const auto& transformPath : s_transformPaths)
+	{
+		if (path == transformPath.path)
+		{
+			return transformPath.name;
+		}
+	}
+	return "unknown";
+}
+
+//Peak resident set of the whole process in KiB, covers every run so far
+static uint64_t getPeakResidentKiB()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters{};
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return counters.PeakWorkingSetSize / 1024;
+	}
+	return 0;
+#else
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+}
+
+//A flat square grid, written as OBJ text with a position and texture coordinate on every corner
+static void writeGridObj(const std::string& path, uint64_t triangles)
+{
+	uint32_t cells = static_cast<uint32_t>(std::ceil(std::sqrt(triangles / 2.0)));
+	std::ofstream file(path, std::ios::trunc);
+	for (uint32_t y = 0; y <= cells; y++)
+	{
+		for (uint32_t x = 0; x <= cells; x++)
+		{
+			float u = x / static_cast<float>(cells);
+			float v = y / static_cast<float>(cells);
+			file << "v " << u << " " << v << " 0\nvt " << u << " " << v << "\n";
+		}
+	}
+	for (uint32_t y = 0; y < cells; y++)
+	{
+		for (uint32_t x = 0; x < cells; x++)
+		{
+			uint32_t corner = y * (cells + 1) + x + 1;
+			uint32_t above = corner + cells + 1;
+			file << "f " << corner << "/" << corner << " " << corner + 1 << "/" << corner + 1 << " " << above + 1 << "/" << above + 1 << "\n";
+			file << "f " << above + 1 << "/" << above + 1 << " " << above << "/" << above << " " << corner << "/" << corner << "\n";
+		}
+	}
+	if (!file.good())
+	{
+		throw std::runtime_error("failed to write " + path + "!");
+	}
+	std::cout << "Mesh load: wrote a " << 2ull * cells * cells << " triangle grid to " << path << std::endl;
+}
+
+//Maps a bake and copies both streams into a buffer the size of the upload, which stands in for the staging ring
+static double loadMapped(const std::string& bakedPath, std::vector<char>& staging)
+{
+	auto start = std::chrono::steady_clock::now();
+	MeshFile baked;
+	baked.open(bakedPath);
+	staging.resize(static_cast<size_t>(baked.getVertexDataSize() + baked.getIndexDataSize()));
+	memcpy(staging.data(), baked.getVertexData(), static_cast<size_t>(baked.getVertexDataSize()));
+	memcpy(staging.data() + baked.getVertexDataSize(), baked.getIndexData(), static_cast<size_t>(baked.getIndexDataSize()));
+	baked.close();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//Best of a few repeats of parsing the OBJ against loading its full precision and packed bakes. Repeats keep every
+//variant reading from the OS file cache, and the staging buffers are sized by a first untimed load
+static void writeMeshLoad(std::ostream& out, const std::string& path, MeshBaker::Options options)
+{
+	const int repeats = 5;
+	options.packedVertices = false;
+	std::string bakedPath = MeshBaker::bake(path, options);
+	options.packedVertices = true;
+	std::string packedPath = MeshBaker::bake(path, options);
+
+	std::vector<char> staging;
+	std::vector<char> packedStaging;
+	loadMapped(bakedPath, staging);
+	loadMapped(packedPath, packedStaging);
+
+	double parseMs = DBL_MAX;
+	double mappedMs = DBL_MAX;
+	double packedMs = DBL_MAX;
+	size_t triangles = 0;
+	size_t vertices = 0;
+	for (int i = 0; i < repeats; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		MeshData mesh = MeshBaker::importObj(path);
+		parseMs = (std::min)(parseMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		triangles = mesh.indices.size() / 3;
+		vertices = mesh.vertices.size();
+
+		mappedMs = (std::min)(mappedMs, loadMapped(bakedPath, staging));
+		packedMs = (std::min)(packedMs, loadMapped(packedPath, packedStaging));
+	}
+
+	MeshData mesh = MeshBaker::importObj(path);
+	MeshBaker::OptimizeStats optimizeStats;
+	optimizeStats.before = MeshOptimizer::analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+	optimizeStats.after = optimizeStats.before;
+	if (options.optimize)
+	{
+		optimizeStats = MeshBaker::optimize(mesh, options.reduceOverdraw);
+	}
+	MeshFile baked;
+	baked.open(bakedPath);
+	uint32_t indexSize = baked.getHeader().indexSize;
+	baked.close();
+
+	std::cout << "Mesh load: " << triangles << " triangles, OBJ parse " << parseMs << "ms, mapped " << mappedMs << "ms, packed "
+		<< packedMs << "ms" << std::endl;
+
+	out << "{ "
+		<< "\"triangles\": " << triangles << ", "
+		<< "\"vertices\": " << vertices << ", "
+		<< "\"obj_bytes\": " << std::filesystem::file_size(path) << ", "
+		<< "\"baked_bytes\": " << std::filesystem::file_size(bakedPath) << ", "
+		<< "\"packed_baked_bytes\": " << std::filesystem::file_size(packedPath) << ", "
+		<< "\"obj_parse_ms\": " << parseMs << ", "
+		<< "\"mapped_load_ms\": " << mappedMs << ", "
+		<< "\"packed_mapped_load_ms\": " << packedMs << ", "
+		<< "\"index_size\": " << indexSize << ", "
+		<< "\"optimize_ms\": " << optimizeStats.optimizeMs << ", "
+		<< "\"acmr_before\": " << optimizeStats.before.acmr << ", "
+		<< "\"acmr_after\": " << optimizeStats.after.acmr << ", "
+		<< "\"atvr_before\": " << optimizeStats.before.atvr << ", "
+		<< "\"atvr_after\": " << optimizeStats.after.atvr << ", "
+		<< "\"speedup\": " << (mappedMs > 0.0 ? parseMs / mappedMs : 0.0) << " }";
+}
+
+static void writePercentiles(std::ostream& out, const FrameProfiler& profiler, FrameProfiler::Metric metric)
+{
+	FrameProfiler::Percentiles percentiles = profiler.getPercentiles(metric);
+	out << "\"" << FrameProfiler::getMetricName(metric) << "\": { "
+		<< "\"p50\": " << percentiles.p50 << ", "
+		<< "\"p95\": " << percentiles.p95 << ", "
+		<< "\"p99\": " << percentiles.p99 << ", "
+		<< "\"average\": " << percentiles.average << ", "
+		<< "\"max\": " << percentiles.max << " }";
+}
+
+int main(int argc, char** argv)
+{
+	VulkanWrapper::Settings base;
+	base.headless = true;
+	base.frameCount = 1000;
+
+	std::vector<std::string> draws = { "1" };
+	std::vector<std::string> presentModes = { "fifo" };
+	std::vector<std::string> recordThreads = { "0" };
+	std::vector<std::string> framesInFlight = { "2" };
+	std::vector<std::string> imageCounts = { "0" };
+	std::vector<std::string> targetLatencies = { "0" };
+	std::vector<std::string> transformPaths = { "push" };
+	std::vector<std::string> bindless = { "off" };
+	std::vector<std::string> gpuDriven = { "off" };
+	std::vector<std::string> textures;
+	std::vector<std::string> vertexFormats = { "float" };
+	std::string meshLoadPath;
+	uint64_t meshTriangles = 0;
+	std::string outputPath;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--frames" && hasValue)
+		{
+			base.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--draws" && hasValue)
+		{
+			draws = split(argv[++i]);
+		}
+		else if (arg == "--record-threads" && hasValue)
+		{
+			recordThreads = split(argv[++i]);
+		}
+		else if (arg == "--present-modes" && hasValue)
+		{
+			presentModes = split(argv[++i]);
+		}
+		else if (arg == "--frames-in-flight" && hasValue)
+		{
+			framesInFlight = split(argv[++i]);
+		}
+		else if (arg == "--image-counts" && hasValue)
+		{
+			imageCounts = split(argv[++i]);
+		}
+		else if (arg == "--target-latency" && hasValue)
+		{
+			targetLatencies = split(argv[++i]);
+		}
+		else if (arg == "--transform-paths" && hasValue)
+		{
+			transformPaths = split(argv[++i]);
+		}
+		else if (arg == "--bindless" && hasValue)
+		{
+			bindless = split(argv[++i]);
+		}
+		else if (arg == "--gpu-driven" && hasValue)
+		{
+			gpuDriven = split(argv[++i]);
+		}
+		else if (arg == "--textures" && hasValue)
+		{
+			textures = split(argv[++i]);
+		}
+		else if (arg == "--mesh" && hasValue)
+		{
+			base.meshPath = argv[++i];
+		}
+		else if (arg == "--vertex-formats" && hasValue)
+		{
+			vertexFormats = split(argv[++i]);
+		}
+		else if (arg == "--mesh-load" && hasValue)
+		{
+			meshLoadPath = argv[++i];
+		}
+		else if (arg == "--mesh-triangles" && hasValue)
+		{
+			meshTriangles = std::stoull(argv[++i]);
+		}
+		else if (arg == "--no-mesh-optimize")
+		{
+			base.optimizeMeshes = false;
+		}
+		else if (arg == "--reduce-overdraw")
+		{
+			base.reduceOverdraw = true;
+		}
+		else if (arg == "--width" && hasValue)
+		{
+			base.width = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--height" && hasValue)
+		{
+			base.height = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--output" && hasValue)
+		{
+			outputPath = argv[++i];
+		}
+		else if (arg == "--windowed")
+		{
+			base.headless = false;
+		}
+		else if (arg == "--no-pipeline-cache")
+		{
+			base.pipelineCachePath.clear();
+		}
+		else
+		{
+			std::cerr << "unknown argument " << arg << std::endl;
+			return 2;
+		}
+	}
+
+	//Nothing is presented when headless, so present modes would only repeat the same run
+	if (base.headless)
+	{
+		presentModes.resize(1);
+	}
+
+	base.texturePaths = textures;
+
+	std::ostringstream results;
+	results << "[";
+	bool first = true;
+
+	try
+	{
+		//Mesh loading is measured on its own and needs no device, so it replaces the renderer runs
+		if (!meshLoadPath.empty())
+		{
+			if (meshTriangles > 0)
+			{
+				writeGridObj(meshLoadPath, meshTriangles);
+			}
+			results << "\n  ";
+			MeshBaker::Options options;
+			options.optimize = base.optimizeMeshes;
+			options.reduceOverdraw = base.reduceOverdraw;
+			writeMeshLoad(results, meshLoadPath, options);
+			first = false;
+		}
+
+		//One run for every combination of the lists, each list multiplies the runs built so far
+		typedef std::pair<VulkanWrapper::Settings, std::string> Run;
+		std::vector<Run> runs;
+		if (meshLoadPath.empty())
+		{
+			runs.push_back(Run(base, base.headless ? "headless" : presentModes.front()));
+		}
+		auto expand = [&runs](const std::vector<std::string>& values, const std::function<void(Run&, const std::string&)>& apply) {
+			std::vector<Run> expanded;
+			for (const Run& run : runs)
+			{
+				for (const std::string& value : values)
+				{
+					expanded.push_back(run);
+					apply(expanded.back(), value);
+				}
+			}
+			runs.swap(expanded);
+		};
+
+		expand(draws, [](Run& run, const std::string& value) { run.first.drawCount = static_cast<uint32_t>(std::stoul(value)); });
+		expand(recordThreads, [](Run& run, const std::string& value) { run.first.recordThreads = static_cast<uint32_t>(std::stoul(value)); });
+		expand(transformPaths, [](Run& run, const std::string& value) { run.first.transformPath = parseTransformPath(value); });
+		expand(bindless, [](Run& run, const std::string& value) { run.first.bindless = value == "on"; });
+		expand(gpuDriven, [](Run& run, const std::string& value) { run.first.gpuDriven = value == "on"; });
+		expand(vertexFormats, [](Run& run, const std::string& value) { run.first.packedVertices = value == "packed"; });
+		expand(presentModes, [](Run& run, const std::string& value) {
+			run.first.presentMode = parsePresentMode(value);
+			run.second = run.first.headless ? "headless" : value;
+		});
+		expand(framesInFlight, [](Run& run, const std::string& value) { run.first.framesInFlight = static_cast<uint32_t>(std::stoul(value)); });
+		expand(imageCounts, [](Run& run, const std::string& value) {
+			uint32_t count = static_cast<uint32_t>(std::stoul(value));
+			run.first.swapchainImageCount = count;
+			if (count > 0)
+			{
+				run.first.offscreenImageCount = count;
+			}
+		});
+		expand(targetLatencies, [](Run& run, const std::string& value) { run.first.targetLatencyMs = std::stod(value); });
+
+		for (const auto& run : runs)
+		{
+			const VulkanWrapper::Settings& settings = run.first;
+			const std::string& presentMode = run.second;
+
+			std::cout << "Benchmark: " << settings.drawCount << " draws, " << settings.recordThreads << " record threads, " << (settings.packedVertices ? "packed vertices, " : "")
+				<< presentMode << ", " << settings.framesInFlight << " frames in flight, " << settings.targetLatencyMs << "ms latency target, "
+				<< settings.frameCount << " frames" << std::endl;
+
+			VulkanWrapper vulkan(settings);
+			vulkan.init();
+			vulkan.run();
+			vulkan.shutdown();
+
+			const VulkanWrapper::RunStats& stats = vulkan.getRunStats();
+			const FrameProfiler& profiler = vulkan.getFrameProfiler();
+
+			//The device can turn bindless and GPU-driven mode down, and GPU-driven mode replaces the transform path
+			std::cout << "Benchmark: ran " << getTransformPathName(stats.transformPath) << " transforms" << (stats.bindless ? ", bindless" : "")
+				<< (stats.gpuDriven ? ", GPU-driven" : "") << ", " << stats.drawCalls << " draw calls per frame" << std::endl;
+
+			results << (first ? "\n" : ",\n") << "  { "
+				<< "\"draws\": " << settings.drawCount << ", "
+				<< "\"record_threads\": " << settings.recordThreads << ", "
+				<< "\"transform_path\": \"" << getTransformPathName(stats.transformPath) << "\", "
+				<< "\"draw_calls\": " << stats.drawCalls << ", "
+				<< "\"bindless\": " << (stats.bindless ? "true" : "false") << ", "
+				<< "\"gpu_driven\": " << (stats.gpuDriven ? "true" : "false") << ", "
+				<< "\"textures\": " << stats.textures << ", "
+				<< "\"texture_upload_mib_s\": " << stats.textureUploadMBps << ", "
+				<< "\"vertex_format\": \"" << (settings.packedVertices ? "packed" : "float") << "\", "
+				<< "\"vertex_stride\": " << stats.vertexStride << ", "
+				<< "\"vertex_bytes\": " << stats.vertexBytes << ", "
+				<< "\"index_size\": " << stats.indexSize << ", "
+				<< "\"present_mode\": \"" << presentMode << "\", "
+				<< "\"frames_in_flight\": " << stats.framesInFlight << ", "
+				<< "\"image_count\": " << stats.imageCount << ", "
+				<< "\"target_latency_ms\": " << settings.targetLatencyMs << ", "
+				<< "\"width\": " << settings.width << ", "
+				<< "\"height\": " << settings.height << ", "
+				<< "\"frames\": " << stats.frames << ", "
+				<< "\"seconds\": " << stats.runSeconds << ", "
+				<< "\"fps\": " << (stats.runSeconds > 0.0 ? stats.frames / stats.runSeconds : 0.0) << ", "
+				<< "\"startup_ms\": " << stats.startupMs << ", "
+				<< "\"first_frame_ms\": " << stats.firstFrameMs << ", "
+				<< "\"peak_gpu_memory_bytes\": " << stats.peakGpuMemory << ", "
+				<< "\"peak_rss_kib\": " << getPeakResidentKiB() << ", ";
+			writePercentiles(results, profiler, FrameProfiler::FrameInterval);
+			results << ", ";
+			writePercentiles(results, profiler, FrameProfiler::CpuFrame);
+			results << ", ";
+			writePercentiles(results, profiler, FrameProfiler::Record);
+			results << ", ";
+			writePercentiles(results, profiler, FrameProfiler::Gpu);
+			results << ", ";
+			writePercentiles(results, profiler, FrameProfiler::Latency);
+			results << ", ";
+			writePercentiles(results, profiler, FrameProfiler::Pacing);
+			results << " }";
+			first = false;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Benchmark failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	results << "\n]\n";
+
+	if (outputPath.empty())
+	{
+		std::cout << results.str();
+	}
+	else
+	{
+		std::ofstream file(outputPath, std::ios::trunc);
+		file << results.str();
+		if (!file.good())
+		{
+			std::cerr << "could not write " << outputPath << std::endl;
+			return 1;
+		}
+		std::cout << "Results written to " << outputPath << std::endl;
+	}
+
+	return 0;
+}
@@ -1,3 +1,6 @@
 C:\VulkanSDK\1.2.198.1\Bin\glslc.exe shader.vert -o vert.spv
 C:\VulkanSDK\1.2.198.1\Bin\glslc.exe shader.frag -o frag.spv
+C:\VulkanSDK\1.2.198.1\Bin\glslc.exe shader_instanced.vert -o vert_instanced.spv
+C:\VulkanSDK\1.2.198.1\Bin\glslc.exe --target-env=vulkan1.2 shader_bindless.frag -o frag_bindless.spv
+C:\VulkanSDK\1.2.198.1\Bin\glslc.exe cull.comp -o cull.spv
 pause
\ No newline at end of file
@@ -1,9 +1,87 @@
 #include <iostream>
+#include <string>
 #include "vulkanWrapper.h"
 
-int main()
+int main(int argc, char** argv)
 {
-	VulkanWrapper vulkan(800,600);
+	VulkanWrapper::Settings settings;
+	settings.width = 800;
+	settings.height = 600;
+
+	//--headless renders offscreen without a window, --frames N stops after N frames,
+	//--profile path writes per-frame timings on exit, --frames-in-flight N and --target-latency ms control frame pacing,
+	//--bindless addresses materials through descriptor indexing where the device supports it, --texture path loads an
+	//image as a texture and can be repeated, --mesh path draws an OBJ (baked on first use) or .mesh file instead of the quad,
+	//--packed-vertices uploads half precision positions and quantised colours, texture coordinates and normals,
+	//--no-mesh-optimize bakes meshes in file order and --reduce-overdraw adds overdraw ordering to the optimisation,
+	//--instanced draws through per-instance vertex attributes with one instanced call per mesh and material,
+	//--gpu-driven culls on the GPU and draws the survivors with indirect count draws
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--headless")
+		{
+			settings.headless = true;
+		}
+		else if (arg == "--frames" && i + 1 < argc)
+		{
+			settings.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--profile" && i + 1 < argc)
+		{
+			settings.profileOutputPath = argv[++i];
+		}
+		else if (arg == "--frames-in-flight" && i + 1 < argc)
+		{
+			settings.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--target-latency" && i + 1 < argc)
+		{
+			settings.targetLatencyMs = std::stod(argv[++i]);
+		}
+		else if (arg == "--bindless")
+		{
+			settings.bindless = true;
+		}
+		else if (arg == "--texture" && i + 1 < argc)
+		{
+			settings.texturePaths.push_back(argv[++i]);
+		}
+		else if (arg == "--mesh" && i + 1 < argc)
+		{
+			settings.meshPath = argv[++i];
+		}
+		else if (arg == "--packed-vertices")
+		{
+			settings.packedVertices = true;
+		}
+		else if (arg == "--no-mesh-optimize")
+		{
+			settings.optimizeMeshes = false;
+		}
+		else if (arg == "--reduce-overdraw")
+		{
+			settings.reduceOverdraw = true;
+		}
+		else if (arg == "--instanced")
+		{
+			settings.transformPath = VulkanWrapper::TransformPath::InstanceAttributes;
+		}
+		else if (arg == "--gpu-driven")
+		{
+			settings.gpuDriven = true;
+		}
+	}
+
+	if (settings.headless && settings.frameCount == 0)
+	{
+		settings.frameCount = 1000;
+	}
+
+	VulkanWrapper vulkan(settings);
+	vulkan.init();
+	vulkan.run();
+	vulkan.shutdown();
 	
 	return 1;
-}
\ No newline at end of file
+}
@@ -1,9 +1,19 @@
 #version 450
 
+//Classic descriptor sets: set 1 holds the one material this draw uses and its texture, see shader_bindless.frag for the bindless variant
+layout(set = 1, binding = 0) uniform Material {
+    vec4 baseColor;
+    uint textureIndex;
+} material;
+
+layout(set = 1, binding = 1) uniform sampler2D materialTexture;
+
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) flat in uint fragMaterial;
+layout(location = 2) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    outColor = vec4(fragColor, 1.0) * material.baseColor * texture(materialTexture, fragTexCoord);
 }
\ No newline at end of file
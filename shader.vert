@@ -1,17 +1,71 @@
 #version 450
 
-layout(binding = 0) uniform UniformBufferObject {
+//How this pipeline fetches per-draw data: 0 push constants, 1 dynamic uniform buffer offset per draw,
+//2 storage buffer indexed by gl_InstanceIndex. Specialized at pipeline creation, so the unused paths compile away
+layout(constant_id = 0) const int TRANSFORM_PATH = 0;
+
+//PackedVertex stores normals octahedron encoded in two components, Vertex stores all three
+layout(constant_id = 1) const bool OCTAHEDRAL_NORMALS = false;
+
+struct ObjectData {
     mat4 model;
+    uint materialIndex;
+};
+
+//Everything but the push constants lives in the frame's uniform ring and is bound with dynamic offsets
+layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 view;
     mat4 proj;
+    vec4 texCoordTransform;
 } ubo;
 
-layout(location = 0) in vec2 inPosition;
+layout(set = 0, binding = 1) uniform ObjectUniforms {
+    ObjectData data;
+} object;
+
+layout(std430, set = 0, binding = 2) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+} objectBuffer;
+
+layout(push_constant) uniform PushConstants {
+    ObjectData data;
+} pushConstants;
+
+layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in vec3 inNormal;
 
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) flat out uint fragMaterial;
+layout(location = 2) out vec2 fragTexCoord;
+
+ObjectData getObject() {
+    if (TRANSFORM_PATH == 1) {
+        return object.data;
+    }
+    if (TRANSFORM_PATH == 2) {
+        return objectBuffer.objects[gl_InstanceIndex];
+    }
+    return pushConstants.data;
+}
+
+vec3 octDecode(vec2 encoded) {
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normal;
+}
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 0.0, 1.0);
-    fragColor = inColor;
+    ObjectData data = getObject();
+    gl_Position = ubo.proj * ubo.view * data.model * vec4(inPosition, 1.0);
+    //Two sided diffuse from a fixed light, enough to show the shape of a mesh
+    vec3 normal = OCTAHEDRAL_NORMALS ? octDecode(inNormal.xy) : inNormal;
+    vec3 worldNormal = normalize(mat3(data.model) * normal);
+    float diffuse = abs(dot(worldNormal, normalize(vec3(1.0, 1.0, 2.0))));
+    fragColor = inColor * (0.35 + 0.65 * diffuse);
+    fragMaterial = data.materialIndex;
+    fragTexCoord = inTexCoord * ubo.texCoordTransform.xy + ubo.texCoordTransform.zw;
 }
\ No newline at end of file
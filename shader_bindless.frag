@@ -0,0 +1,32 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+//Bindless variant of shader.frag: set 1 is the BindlessHeap, materials are looked up in the material table by the
+//draw's material index and the table itself is found through a push constant
+struct Material {
+    vec4 baseColor;
+    uint textureIndex;
+};
+
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+layout(std430, set = 1, binding = 1) readonly buffer MaterialBuffer {
+    Material materials[];
+} buffers[];
+
+//Offset past the vertex stage's ObjectData
+layout(push_constant) uniform BindlessIndices {
+    layout(offset = 80) uint materialBuffer;
+} indices;
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) flat in uint fragMaterial;
+layout(location = 2) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    Material material = buffers[indices.materialBuffer].materials[fragMaterial];
+    vec4 texel = texture(textures[nonuniformEXT(material.textureIndex)], fragTexCoord);
+    outColor = vec4(fragColor, 1.0) * material.baseColor * texel;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#version 450
+
+//shader.vert for TransformPath::InstanceAttributes: the per-draw data comes from a second vertex binding stepped
+//per instance (InstanceData in vertex.h) instead of from push constants or the uniform ring
+layout(constant_id = 1) const bool OCTAHEDRAL_NORMALS = false;
+
+layout(set = 0, binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+    vec4 texCoordTransform;
+} ubo;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in vec3 inNormal;
+
+layout(location = 4) in vec4 inModelRow0;
+layout(location = 5) in vec4 inModelRow1;
+layout(location = 6) in vec4 inModelRow2;
+layout(location = 7) in vec4 inInstanceColor;
+layout(location = 8) in uint inMaterial;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) flat out uint fragMaterial;
+layout(location = 2) out vec2 fragTexCoord;
+
+vec3 octDecode(vec2 encoded) {
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normal;
+}
+
+void main() {
+    mat4 model = transpose(mat4(inModelRow0, inModelRow1, inModelRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+    gl_Position = ubo.proj * ubo.view * model * vec4(inPosition, 1.0);
+    vec3 normal = OCTAHEDRAL_NORMALS ? octDecode(inNormal.xy) : inNormal;
+    vec3 worldNormal = normalize(mat3(model) * normal);
+    float diffuse = abs(dot(worldNormal, normalize(vec3(1.0, 1.0, 2.0))));
+    fragColor = inColor * inInstanceColor.rgb * (0.35 + 0.65 * diffuse);
+    fragMaterial = inMaterial;
+    fragTexCoord = inTexCoord * ubo.texCoordTransform.xy + ubo.texCoordTransform.zw;
+}
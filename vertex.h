@@ -1,41 +1,128 @@
 #pragma once
-#include <glm/glm.hpp>
-#include <array>
+#include "VertexLayout.h"
 
+//Full precision vertex, 44 bytes. Attribute locations follow member order
 struct Vertex 
 {
-	glm::vec2 pos;
+	glm::vec3 pos;
 	glm::vec3 color;
+	glm::vec2 texCoord;
+	glm::vec3 normal;
+};
+
+//The same attributes in 20 bytes: half precision positions, 8-bit colours, 16-bit texture coordinates (clamped to
+//[-1, 1], baked meshes remap theirs into it, see MeshFile::getTexCoordTransform) and octahedral normals
+struct PackedVertex
+{
+	Half4 pos;
+	Unorm8x4 color;
+	Snorm16x2 texCoord;
+	OctNormal normal;
+};
 
-	static VkVertexInputBindingDescription getBindingDescription() 
-	{
-		VkVertexInputBindingDescription bindingDescription{};
-		bindingDescription.binding = 0;
-		bindingDescription.stride = sizeof(Vertex);
-		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+PackedVertex packVertex(const Vertex& vertex);
+
+//Per-instance attributes, fetched from binding 1 at VK_VERTEX_INPUT_RATE_INSTANCE by shader_instanced.vert from the
+//location after the last vertex attribute. The model matrix is stored as the top three rows of the affine transform,
+//56 bytes in all
+struct InstanceData
+{
+	glm::vec4 modelRow0;
+	glm::vec4 modelRow1;
+	glm::vec4 modelRow2;
+	//Multiplied into the vertex colour
+	Unorm8x4 color;
+	uint32_t materialIndex;
+};
 
-		return bindingDescription;
-	}
+//The bottom row of model is assumed to be (0, 0, 0, 1)
+InstanceData packInstance(const glm::mat4& model, const glm::vec4& color, uint32_t materialIndex);
 
-	static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions() 
-	{
-		std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions{};
-		attributeDescriptions[0].binding = 0;
-		attributeDescriptions[0].location = 0;
-		attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-		attributeDescriptions[0].offset = offsetof(Vertex, pos);
+template<> struct VertexAttributes<Vertex>
+{
+	static constexpr std::array<VertexAttribute, 4> value = { {
+		VERTEX_ATTRIBUTE(Vertex, pos),
+		VERTEX_ATTRIBUTE(Vertex, color),
+		VERTEX_ATTRIBUTE(Vertex, texCoord),
+		VERTEX_ATTRIBUTE(Vertex, normal),
+	} };
+};
 
-		attributeDescriptions[1].binding = 0;
-		attributeDescriptions[1].location = 1;
-		attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[1].offset = offsetof(Vertex, color);
+template<> struct VertexAttributes<PackedVertex>
+{
+	static constexpr std::array<VertexAttribute, 4> value = { {
+		VERTEX_ATTRIBUTE(PackedVertex, pos),
+		VERTEX_ATTRIBUTE(PackedVertex, color),
+		VERTEX_ATTRIBUTE(PackedVertex, texCoord),
+		VERTEX_ATTRIBUTE(PackedVertex, normal),
+	} };
+};
 
-		return attributeDescriptions;
-	}
+template<> struct VertexAttributes<InstanceData>
+{
+	static constexpr std::array<VertexAttribute, 5> value = { {
+		VERTEX_ATTRIBUTE(InstanceData, modelRow0),
+		VERTEX_ATTRIBUTE(InstanceData, modelRow1),
+		VERTEX_ATTRIBUTE(InstanceData, modelRow2),
+		VERTEX_ATTRIBUTE(InstanceData, color),
+		VERTEX_ATTRIBUTE(InstanceData, materialIndex),
+	} };
 };
 
+//Constants shared by every draw in a frame, set 0 binding 0 in shader.vert
 struct UniformBufferObject {
-	glm::mat4 model;
 	glm::mat4 view;
 	glm::mat4 proj;
+	//Scale in xy and offset in zw applied to the vertex texture coordinates
+	glm::vec4 texCoordTransform;
+};
+
+//Constants for one draw, ObjectData in shader.vert. Delivered as push constants, through the dynamic uniform binding 1
+//or as an element of the storage buffer at binding 2, so it is padded to the std140/std430 struct size of 80 bytes
+struct ObjectUniforms {
+	glm::mat4 model;
+	uint32_t materialIndex;
+	uint32_t padding[3];
+};
+
+//One entry of the material table, Material in the fragment shaders. Bindless mode reads it from a storage buffer
+//(std430), classic mode binds one entry as a uniform buffer (std140) next to its texture; both lay it out in 32 bytes
+struct MaterialData {
+	glm::vec4 baseColor;
+	//Index into the bindless texture array, unused by classic sets
+	uint32_t textureIndex;
+	uint32_t padding[3];
+};
+
+//Fragment push constants in bindless mode, placed after the vertex stage's ObjectUniforms
+struct BindlessIndices {
+	uint32_t materialBuffer;
+};
+
+//GPU-driven mode: one object of the scene, GpuObject in cull.comp (std430, 80 bytes). Visible objects claim a slot in
+//their bucket's range of the indirect command buffer, which starts at commandBase
+struct GpuObject {
+	glm::mat4 model;
+	uint32_t materialIndex;
+	uint32_t mesh;
+	uint32_t bucket;
+	uint32_t commandBase;
+};
+
+//An index range the GPU-driven scene draws from, with its bounding sphere (centre, radius) in mesh space. GpuMesh in
+//cull.comp, 32 bytes
+struct GpuMesh {
+	glm::vec4 boundingSphere;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t padding[2];
+};
+
+//Per-frame constants of the culling pass (std140). sceneModel is applied on top of every object's model, the planes
+//point into the frustum and are in world space
+struct CullUniforms {
+	glm::mat4 sceneModel;
+	glm::vec4 frustumPlanes[6];
+	uint32_t objectCount;
+	uint32_t padding[3];
 };
\ No newline at end of file
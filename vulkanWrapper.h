@@ -5,7 +5,25 @@
 #include <vector>
 #include <optional>
 #include <fstream>
+#include <string>
+#include <chrono>
 #include "vertex.h"
+#include "PipelineCache.h"
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
+#include "FrameProfiler.h"
+#include "ShaderLibrary.h"
+#include "StartupTimeline.h"
+#include "ThreadPool.h"
+#include "FrameContext.h"
+#include "FramePacer.h"
+#include "TimelineSemaphore.h"
+#include "DeletionQueue.h"
+#include "DescriptorAllocator.h"
+#include "BindlessHeap.h"
+#include "TextureManager.h"
+#include "MeshFile.h"
+#include "InstanceBatcher.h"
 
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
@@ -16,13 +34,136 @@ const bool enableValidationLayers = true;
 class VulkanWrapper
 {
 public:
+	//How each draw's ObjectUniforms reach the vertex shader, see TRANSFORM_PATH in shader.vert. InstanceAttributes
+	//instead feeds InstanceData through a per-instance vertex binding to shader_instanced.vert and groups the draws
+	//into one instanced call per mesh (and material, with classic sets)
+	enum class TransformPath
+	{
+		PushConstants,
+		DynamicUniform,
+		StorageBuffer,
+		InstanceAttributes
+	};
+
+	struct Settings
+	{
+		uint32_t width = 800;
+		uint32_t height = 600;
+
+		//Render into a ring of offscreen images instead of a window/swapchain,
+		//so frames can be produced on machines with no display (e.g. lavapipe/SwiftShader)
+		bool headless = false;
+		uint32_t offscreenImageCount = 3;
+
+		//Number of frames drawn before run() returns, 0 runs until the window is closed
+		uint32_t frameCount = 0;
+
+		//Pipeline cache file loaded at startup and written back on shutdown, empty disables persistence
+		std::string pipelineCachePath = "pipeline_cache.bin";
+
+		//Run uploads on a dedicated transfer queue family when the device exposes one
+		bool useTransferQueue = true;
+		//Create a compute queue separate from the graphics queue so compute work can overlap rendering
+		bool useAsyncComputeQueue = true;
+
+		//Number of times the mesh is drawn each frame, scales the scene for benchmarking. With instance attributes these
+		//are only drawn on frames the host submitted nothing for with drawInstances()
+		uint32_t drawCount = 1;
+
+		//Worker threads that record the draws into secondary command buffers, 0 records inline into the primary
+		uint32_t recordThreads = 0;
+
+		//Push constants are the fast path, the other two exist to compare against it
+		TransformPath transformPath = TransformPath::PushConstants;
+
+		//Address materials and textures by index from one update-after-bind descriptor set instead of binding a set per
+		//material. Needs descriptor indexing, devices without it fall back to classic sets
+		bool bindless = false;
+
+		//Cull the drawCount objects on the GPU and draw the survivors with vkCmdDrawIndexedIndirectCount, one call per
+		//material (one in all with bindless) whatever the object count. Reads ObjectData through the storage buffer
+		//path and replaces transformPath. Needs drawIndirectCount, multiDrawIndirect and drawIndirectFirstInstance,
+		//devices without them record the draws on the CPU, still through the storage buffer path
+		bool gpuDriven = false;
+
+		//Image files loaded as textures at startup, each gets a material and the draws cycle through them
+		std::vector<std::string> texturePaths;
+
+		//OBJ or baked .mesh file drawn instead of the built-in quad. An OBJ is baked to path + ".mesh" on first use
+		std::string meshPath;
+
+		//Upload and fetch PackedVertex (20 bytes) instead of Vertex (44 bytes). A .mesh given directly has to have
+		//been baked in the same format
+		bool packedVertices = false;
+
+		//Bake options for meshPath, changing them rebakes the mesh. Optimisation reorders for the post-transform cache
+		//and vertex fetch; overdraw reduction additionally orders triangle clusters outside-in
+		bool optimizeMeshes = true;
+		bool reduceOverdraw = false;
+
+		//Host-visible scratch memory each frame in flight can bump-allocate transient data from
+		VkDeviceSize frameScratchSize = 1024 * 1024;
+
+		//Preferred present mode (FIFO, FIFO_RELAXED, MAILBOX or IMMEDIATE), FIFO is used when the surface does not support it
+		VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+
+		//Frames the CPU may record ahead of the GPU, clamped to 1..4. More overlaps CPU and GPU work better at the cost of latency
+		uint32_t framesInFlight = 2;
+		//Swapchain images requested, 0 asks for one more than the surface minimum. Clamped to what the surface supports
+		uint32_t swapchainImageCount = 0;
+		//Input-to-GPU-completion latency the frame pacer aims for, 0 disables the limiter
+		double targetLatencyMs = 0.0;
+
+		//Per-frame timings are written here on shutdown, .json gets a percentile summary, anything else a CSV per frame
+		std::string profileOutputPath;
+	};
+
+	//Filled in as the wrapper runs, still readable after shutdown()
+	struct RunStats
+	{
+		double startupMs = 0.0;
+		//From the start of init() until the first frame has been submitted
+		double firstFrameMs = 0.0;
+		double runSeconds = 0.0;
+		uint32_t frames = 0;
+		VkDeviceSize peakGpuMemory = 0;
+		//Pacing configuration actually used, after clamping to what the device and surface allow
+		uint32_t framesInFlight = 0;
+		uint32_t imageCount = 0;
+		//False when bindless was requested but the device fell back to classic sets
+		bool bindless = false;
+		//Likewise for gpuDriven
+		bool gpuDriven = false;
+		//Transform path the draws used, always StorageBuffer when gpuDriven was requested
+		TransformPath transformPath = TransformPath::PushConstants;
+		//Textures in texturePaths plus the default one, and the rate their top levels were uploaded at
+		uint32_t textures = 0;
+		double textureUploadMBps = 0.0;
+		//Size of the vertex buffer every draw fetches from
+		uint32_t vertexStride = 0;
+		VkDeviceSize vertexBytes = 0;
+		uint32_t indexSize = 0;
+		//Draw calls recorded for the last frame, GPU-driven mode counts each indirect count draw once
+		uint32_t drawCalls = 0;
+	};
+
 	VulkanWrapper(uint32_t width, uint32_t height);
+	VulkanWrapper(const Settings& settings);
 	~VulkanWrapper();
 
+	VulkanWrapper(const VulkanWrapper&) = delete;
+	VulkanWrapper& operator=(const VulkanWrapper&) = delete;
+
 	struct QueueFamilyIndices
 	{
 		std::optional<uint32_t> graphicsFamily;
 		std::optional<uint32_t> presentFamily;
+		std::optional<uint32_t> transferFamily;
+		std::optional<uint32_t> computeFamily;
+
+		//Queue index inside its family, non-zero when a queue shares a family with graphics but got its own slot
+		uint32_t transferQueueIndex = 0;
+		uint32_t computeQueueIndex = 0;
 
 		bool isComplete() 
 		{
@@ -38,32 +179,66 @@ public:
 	};
 
 
+	//init() once, then either run() or one tick() per frame from the host's own loop, then shutdown().
+	//shutdown() is safe to call more than once and the destructor calls it, so a wrapper whose init() threw
+	//part way through still releases whatever it had created
+	void init();
+	void run();
+	bool tick();
+	void shutdown();
+
 	void initWindow();
 	void initialiseVulkan();
-	void mainloop();
 	void cleanUp();
+	void printRunReport();
 	void createLogicalDevice();
+	void createPipelineCache();
+	void createAllocator();
 	void createSurface();
 	void createSwapChain();
+	void createOffscreenTargets();
 	void createImageViews();
 	void createGraphicsPipeline();
 	void createRenderPass();
 	void createFrameBuffers();
-	void createCommandPool();
+	void createFrameContexts();
+	void destroyFrameContexts();
+	void createUploadManager();
+	void createFrameProfiler();
 	void createVertexBuffers();
 	void createIndexBuffer();
+	void loadMesh();
+	void createDescriptorCaches();
+	void destroyDescriptorCaches();
 	void createDescriptorSetLayout();
-	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-	void createCommandBuffers();
+	void createMaterialSetLayout();
+	void createMaterials();
+	uint32_t getDrawMaterial(uint32_t draw) const;
+	bool supportsBindless(VkPhysicalDevice device);
+	bool supportsGpuDriven(VkPhysicalDevice device);
+	void createCullSetLayout();
+	void createCullPipeline();
+	void createGpuScene();
+	void destroyGpuScene();
+	void recordCulling(VkCommandBuffer commandBuffer);
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, MemoryAllocation& bufferMemory);
+	void destroyBuffer(VkBuffer& buffer, MemoryAllocation& bufferMemory);
+	//Like destroyBuffer but safe while frames are in flight: released once the GPU is done with it
+	void retireBuffer(VkBuffer& buffer, MemoryAllocation& bufferMemory);
+	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory);
+	void destroyImage(VkImage& image, MemoryAllocation& imageMemory);
 	void createSyncObjects();
 	void recreateSwapchain();
 	void cleanUpSwapchain();
+	void cleanUpSwapchainViews();
+	void retireSwapchainViews();
 
 	void drawFrame();
+	void drawOffscreenFrame();
+	void paceFrame();
+	void submitFrame(VkCommandBuffer commandBuffer, SubmitSemaphores& semaphores);
 
 
-	static std::vector<char> readFile(const std::string& filename);
-	VkShaderModule createShaderModule(const std::vector<char>& code);
 
 	void createInstance();
 	void selectPhysicalDevice();
@@ -80,13 +255,41 @@ public:
 	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
 	
 	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void recordSecondaryCommandBuffers(uint32_t imageIndex);
+	void recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount);
+	uint32_t getRecordCount() const;
+	void writeFrameUniforms();
+	void writeFrameInstances();
+	void createRecordingThreads();
+	void destroyRecordingThreads();
 
 	std::vector<const char*> getRequiredExtensions();
+	std::vector<const char*> getRequiredDeviceExtensions();
 	const std::vector<const char*> m_deviceExtensions = {	VK_KHR_SWAPCHAIN_EXTENSION_NAME	};
 
+	bool isHeadless() const { return m_settings.headless; }
+	const QueueFamilyIndices& getQueueFamilies() const { return m_queueFamilies; }
+	VkQueue getGraphicsQueue() const { return m_graphicsQueue; }
+	VkQueue getPresentQueue() const { return m_presentQueue; }
+	VkQueue getTransferQueue() const { return m_transferQueue; }
+	VkQueue getComputeQueue() const { return m_computeQueue; }
+	uint32_t getFramesRendered() const { return m_framesRendered; }
+
+	//Mesh 0 is the whole geometry, followed by one mesh per submesh of a loaded mesh file
+	uint32_t getMeshCount() const { return static_cast<uint32_t>(m_meshRanges.size()); }
+	uint32_t getMaterialCount() const { return static_cast<uint32_t>(m_materials.size()); }
+
+	//Queues instances of a mesh for the next frame, instance attributes path only. Call from the thread calling
+	//tick(); instances of the same mesh and material are drawn together however many calls they arrived in.
+	//Each frame's instances go through its own instance buffer, which grows to fit whatever was queued
+	void drawInstances(uint32_t mesh, uint32_t material, const InstanceData* instances, uint32_t instanceCount);
+
 	void setFrameBufferResized(bool resized) { m_framebufferResized = resized; }
 
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+	MemoryAllocator::Stats getMemoryStats() const { return m_allocator.getStats(); }
+	const FrameProfiler& getFrameProfiler() const { return m_profiler; }
+	const RunStats& getRunStats() const { return m_runStats; }
 
 	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
@@ -99,10 +302,10 @@ public:
 	//};
 
 	const std::vector<Vertex> m_vertices = {
-	{{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
-	{{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},
-	{{0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
-	{{-0.5f, 0.5f}, {1.0f, 1.0f, 1.0f}}
+	{{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+	{{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+	{{0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
+	{{-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}}
 	};
 
 	const std::vector<uint16_t> m_indices = {
@@ -110,6 +313,9 @@ public:
 	};
 
 private:
+	Settings m_settings;
+	RunStats m_runStats;
+
 	GLFWwindow* m_window;                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                         
 
 	uint32_t m_windowWidth;
@@ -118,9 +324,13 @@ private:
 	VkInstance m_vkInstance;
 	VkPhysicalDevice m_physicalDevice;
 	VkDevice m_logicalDevice;
+	MemoryAllocator m_allocator;
 
+	QueueFamilyIndices m_queueFamilies;
 	VkQueue m_graphicsQueue;
 	VkQueue m_presentQueue;
+	VkQueue m_transferQueue;
+	VkQueue m_computeQueue;
 
 	VkSurfaceKHR m_surface;
 
@@ -130,27 +340,149 @@ private:
 	VkExtent2D m_swapChainExtent;
 	std::vector<VkImageView> m_swapChainImageViews;
 
+	//Headless only: backing memory for the offscreen images held in m_swapChainImages
+	std::vector<MemoryAllocation> m_offscreenImageMemory;
+	uint32_t m_offscreenImageIndex = 0;
+
+	StartupTimeline m_timeline;
+	ShaderLibrary m_shaders;
+	PipelineCache m_pipelineCache;
 	VkPipeline m_graphicsPipeline;
 	VkRenderPass m_renderPass;
-	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorSetLayout m_descriptorSetLayout;
 	VkPipelineLayout m_pipelineLayout;
 
-	VkCommandPool m_commandPool;
+	//Layouts are owned by the layout cache. The allocator and set cache hold sets that live as long as the device,
+	//such as each FrameContext's uniform set; per-frame sets come from the FrameContext instead
+	DescriptorLayoutCache m_descriptorLayoutCache;
+	DescriptorAllocator m_descriptorAllocator;
+	DescriptorSetCache m_descriptorSetCache;
+
+	UploadManager m_uploadManager;
+	FrameProfiler m_profiler;
 	VkBuffer m_vertexBuffer;
-	VkDeviceMemory m_vertexBufferMemory;
+	MemoryAllocation m_vertexBufferMemory;
 	VkBuffer m_indexBuffer;
-	VkDeviceMemory m_indexBufferMemory;
-
-	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VkDeviceMemory> uniformBuffersMemory;
+	MemoryAllocation m_indexBufferMemory;
+
+	//Material table indexed by ObjectUniforms::materialIndex, entries m_materialStride apart in m_materialBuffer.
+	//Set 1 is the bindless heap, which addresses the table as a storage buffer, or in classic mode one uniform buffer
+	//set per material from m_descriptorSetCache
+	std::vector<MaterialData> m_materials;
+	//TextureManager index of each material's texture
+	std::vector<uint32_t> m_materialTextures;
+	VkBuffer m_materialBuffer;
+	MemoryAllocation m_materialBufferMemory;
+	VkDeviceSize m_materialStride = 0;
+	VkDescriptorSetLayout m_materialSetLayout;
+	std::vector<VkDescriptorSet> m_materialSets;
+	bool m_bindless = false;
+	BindlessHeap m_bindlessHeap;
+	uint32_t m_materialBufferIndex = BindlessHeap::s_invalidIndex;
+
+	//Texture 0 is a 1x1 white texture for untextured materials, the rest come from Settings::texturePaths
+	TextureManager m_textures;
+	std::vector<uint32_t> m_loadedTextures;
+	float m_maxAnisotropy = 1.0f;
+
+	//One per frame in flight, indexed by m_currentFrame
+	std::vector<FrameContext> m_frames;
+
+	//Where the frame being recorded put its constants in its FrameContext's uniform ring. Filled in by
+	//writeFrameUniforms() before recording starts; workers then write only the per-draw slots of their own draws.
+	//Object slots are strided dynamic uniform slots or a packed storage buffer array, and absent for push constants
+	struct FrameUniforms
+	{
+		uint32_t frameOffset = 0;
+		uint32_t objectOffset = 0;
+		uint32_t objectStride = 0;
+		char* objectData = nullptr;
+		glm::mat4 model = glm::mat4(1.0f);
+		//Instance attributes path only: the buffer holding this frame's batched InstanceData
+		VkBuffer instanceBuffer = VK_NULL_HANDLE;
+		//GPU-driven mode only: this frame's CullUniforms
+		uint32_t cullOffset = 0;
+	};
+	FrameUniforms m_frameUniforms;
+
+	//Geometry drawn by every draw: the mapped mesh while its streams are uploaded, or m_vertices/m_indices. The
+	//mesh transform centres the mesh and scales it to the quad's size, the texture coordinate one undoes the bake's remap
+	MeshFile m_mesh;
+	uint32_t m_indexCount = 0;
+	VkIndexType m_indexType = VK_INDEX_TYPE_UINT16;
+	glm::mat4 m_meshTransform = glm::mat4(1.0f);
+	glm::vec4 m_texCoordTransform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+	uint32_t m_vertexCount = 0;
+
+	//Index ranges drawInstances() and the GPU-driven scene can address, see getMeshCount()
+	struct MeshRange
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		MeshBounds bounds;
+	};
+	std::vector<MeshRange> m_meshRanges;
+	InstanceBatcher m_instanceBatcher;
+	//Instance attributes path: one persistently mapped vertex buffer per frame in flight. A frame that queues more
+	//instances than its buffer holds swaps in one twice the size and retires the old one
+	struct InstanceStream
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		MemoryAllocation memory;
+		VkDeviceSize capacity = 0;
+	};
+	std::vector<InstanceStream> m_instanceStreams;
 
-	std::vector<VkCommandBuffer> m_commandBuffers;
+	//GPU-driven mode: GpuObjects and GpuMeshes uploaded once, and per frame in flight the indirect commands and bucket
+	//counters cull.comp writes plus the set it writes them through. A bucket is the range of commands drawn with one
+	//material bound
+	struct GpuBucket
+	{
+		uint32_t material;
+		uint32_t commandBase;
+		uint32_t capacity;
+	};
+	struct GpuFrame
+	{
+		VkBuffer commandBuffer = VK_NULL_HANDLE;
+		MemoryAllocation commandMemory;
+		VkBuffer countBuffer = VK_NULL_HANDLE;
+		MemoryAllocation countMemory;
+		VkDescriptorSet cullSet = VK_NULL_HANDLE;
+	};
+	bool m_gpuDriven = false;
+	uint32_t m_gpuObjectCount = 0;
+	std::vector<GpuBucket> m_gpuBuckets;
+	std::vector<GpuFrame> m_gpuFrames;
+	VkBuffer m_gpuObjectBuffer = VK_NULL_HANDLE;
+	MemoryAllocation m_gpuObjectMemory;
+	VkBuffer m_gpuMeshBuffer = VK_NULL_HANDLE;
+	MemoryAllocation m_gpuMeshMemory;
+	VkDescriptorSetLayout m_cullSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout m_cullPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline m_cullPipeline = VK_NULL_HANDLE;
+
+	VkDeviceSize m_uniformAlignment = 1;
+	VkDeviceSize m_storageAlignment = 1;
+
+	//Multithreaded recording: each worker records into its own pool and secondary buffer in the current FrameContext
+	ThreadPool m_recordPool;
+	std::vector<uint32_t> m_secondaryDrawCounts;
 
 	std::vector<VkFramebuffer> m_swapChainFramebuffers;
 
+	//Binary semaphores are still needed for acquire and present, which do not accept timeline semaphores.
+	//Everything else waits on m_frameTimeline: each frame slot remembers the value its last submission signals
 	std::vector<VkSemaphore> m_imageAvailableSemaphores;
 	std::vector<VkSemaphore> m_renderFinishedSemaphores;
-	std::vector<VkFence> m_inFlightFences;
+	TimelineSemaphore m_frameTimeline;
+	std::vector<uint64_t> m_frameValues;
+
+	//Objects dropped mid-run wait here until the frame timeline has passed every frame that could still use them
+	DeletionQueue m_deletionQueue;
+
+	FramePacer m_pacer;
+	double m_pacingMs = 0.0;
 
 	const std::vector<const char*> m_validationLayers = {
 	"VK_LAYER_KHRONOS_validation" };
@@ -158,7 +490,13 @@ private:
 	VkDebugUtilsMessengerEXT m_debugMessenger;
 
 	uint32_t m_currentFrame;
+	uint32_t m_framesRendered = 0;
 	bool m_framebufferResized = false;
+	bool m_glfwInitialised = false;
+
+	bool m_runStarted = false;
+	std::chrono::steady_clock::time_point m_runStart;
 
-	static const int m_maxFramesInFlight = 2;
+	uint32_t m_framesInFlight;
+	static constexpr uint32_t m_maxFramesInFlight = 4;
 };
\ No newline at end of file